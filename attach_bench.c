@@ -0,0 +1,267 @@
+/*
+ * qt-attach-bench-<backend> measures what attaching N keyboards costs with
+ * one input backend (it is built once per backend): the time until the
+ * first one is attached, the time until all are, and the resident memory
+ * once all device threads have read an event and gone idle.
+ *
+ * Usage: qt-attach-bench-<backend> [-n devices]
+ *
+ * Attaching does what the daemon does per device: set up the backend, check
+ * for keys, get the name and phys path, switch to CLOCK_MONOTONIC, and
+ * start a thread reading events. The devices are pipes, and the evdev ioctls
+ * on them are answered by fake_ioctl() below, as by a keyboard. So both
+ * backends see the same N devices, without needing uinput or root.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/input.h>
+
+#include "input_backend.h"
+#include "test_util.h"
+
+#ifndef BACKEND_NAME
+#define BACKEND_NAME "unknown"
+#endif
+
+enum { max_fds = 65536 };
+
+/* fake[fd] is set for the read ends of the fake devices */
+static bool fake[max_fds];
+
+static atomic_int num_events;
+
+/* fake_ioctl answers evdev ioctls like a plain keyboard would. */
+static int fake_ioctl(unsigned long request, void *arg) {
+  unsigned nr = _IOC_NR(request);
+  unsigned size = _IOC_SIZE(request);
+
+  if (_IOC_TYPE(request) != 'E') {
+    errno = ENOTTY;
+    return -1;
+  }
+
+  switch (request) {
+  case EVIOCGVERSION:
+    *(int *)arg = EV_VERSION;
+    return 0;
+  case EVIOCGID:
+    memset(arg, 0, sizeof(struct input_id));
+    ((struct input_id *)arg)->bustype = BUS_VIRTUAL;
+    return 0;
+  case EVIOCGREP:
+    ((unsigned int *)arg)[0] = 250;
+    ((unsigned int *)arg)[1] = 33;
+    return 0;
+  case EVIOCSCLOCKID:
+  case EVIOCGRAB:
+    return 0;
+  }
+
+  if (_IOC_DIR(request) != _IOC_READ) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Variable length reads: name, phys, uniq, properties, state, bits */
+  if (nr == _IOC_NR(EVIOCGNAME(0)) || nr == _IOC_NR(EVIOCGPHYS(0))) {
+    const char *str =
+        nr == _IOC_NR(EVIOCGNAME(0)) ? "qt-attach-bench keyboard" : "bench/input0";
+    size_t len = strlen(str) + 1 < size ? strlen(str) + 1 : size;
+    memcpy(arg, str, len);
+    ((char *)arg)[len - 1] = '\0';
+    return len;
+  }
+
+  if (nr == _IOC_NR(EVIOCGUNIQ(0))) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (nr == _IOC_NR(EVIOCGPROP(0)) || nr == _IOC_NR(EVIOCGKEY(0)) ||
+      nr == _IOC_NR(EVIOCGLED(0)) || nr == _IOC_NR(EVIOCGSND(0)) ||
+      nr == _IOC_NR(EVIOCGSW(0)) || nr == _IOC_NR(EVIOCGMTSLOTS(0))) {
+    memset(arg, 0, size);
+    return size;
+  }
+
+  if (nr >= _IOC_NR(EVIOCGBIT(0, 0)) && nr < _IOC_NR(EVIOCGBIT(EV_MAX, 0))) {
+    unsigned type = nr - _IOC_NR(EVIOCGBIT(0, 0));
+    unsigned char *bits = arg;
+
+    memset(bits, 0, size);
+    if (type == 0) {
+      bits[EV_SYN / 8] |= 1 << (EV_SYN % 8);
+      bits[EV_KEY / 8] |= 1 << (EV_KEY % 8);
+      bits[EV_REP / 8] |= 1 << (EV_REP % 8);
+    } else if (type == EV_KEY) {
+      /* The main block of a keyboard */
+      for (unsigned key = KEY_ESC; key <= KEY_KPDOT && key / 8 < size; key++)
+        bits[key / 8] |= 1 << (key % 8);
+    }
+    return size;
+  }
+
+  if (nr >= _IOC_NR(EVIOCGABS(0)) && nr < _IOC_NR(EVIOCGABS(ABS_CNT))) {
+    memset(arg, 0, size);
+    return 0;
+  }
+
+  errno = EINVAL;
+  return -1;
+}
+
+/*
+ * ioctl overrides libc's, also for libevdev, so that ioctls on fake devices
+ * can be answered. Everything else goes to the kernel.
+ */
+int ioctl(int fd, unsigned long request, ...) {
+  va_list args;
+  va_start(args, request);
+  void *arg = va_arg(args, void *);
+  va_end(args);
+
+  if (fd >= 0 && fd < max_fds && fake[fd])
+    return fake_ioctl(request, arg);
+  return syscall(SYS_ioctl, fd, request, arg);
+}
+
+/* device_thread reads events, like the daemon's device threads. */
+static void *device_thread(void *arg) {
+  struct input_backend *backend = arg;
+  struct input_event event;
+
+  while (0 == input_backend_next_event(backend, &event))
+    if (event.type == EV_KEY)
+      atomic_fetch_add(&num_events, 1);
+
+  return NULL;
+}
+
+/* attach sets up the device at fd like the daemon does. Returns 1 on error. */
+static int attach(int fd) {
+  struct input_backend *backend;
+  pthread_attr_t attr;
+  pthread_t thread;
+
+  if (0 != input_backend_open(fd, &backend))
+    return 1;
+
+  if (!input_backend_has_keys(backend) || !input_backend_get_name(backend)) {
+    fprintf(stderr, "error: fake device not taken for a keyboard\n");
+    goto err;
+  }
+  input_backend_get_phys(backend);
+  if (0 != input_backend_set_clock_monotonic(backend))
+    goto err;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  errno = pthread_create(&thread, &attr, device_thread, backend);
+  pthread_attr_destroy(&attr);
+  if (errno) {
+    fprintf(stderr, "error: failed to create thread: %m\n");
+    goto err;
+  }
+
+  return 0;
+
+err:
+  input_backend_free(backend);
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  int num_devices = 64;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:h")) != -1) {
+    switch (opt) {
+    case 'n':
+      num_devices = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n devices]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (num_devices < 1) {
+    fprintf(stderr, "usage: %s [-n devices]\n", argv[0]);
+    return 1;
+  }
+
+  int (*pipes)[2] = calloc(num_devices, sizeof(*pipes));
+  if (!pipes) {
+    fprintf(stderr, "error: %m\n");
+    return 1;
+  }
+
+  /* Creating the devices is not part of attaching them */
+  for (int i = 0; i < num_devices; i++) {
+    if (0 != pipe(pipes[i]) || pipes[i][0] >= max_fds) {
+      fprintf(stderr, "error: failed to create device %d: %m\n", i);
+      return 1;
+    }
+    fake[pipes[i][0]] = true;
+  }
+
+  long idle_rss = rss_kb(0);
+
+  int64_t start = now_ns();
+  int64_t first_ns = 0;
+  for (int i = 0; i < num_devices; i++) {
+    if (0 != attach(pipes[i][0]))
+      return 1;
+    if (i == 0)
+      first_ns = now_ns() - start;
+  }
+  int64_t all_ns = now_ns() - start;
+
+  /* One key per device, so that every thread has read once */
+  for (int i = 0; i < num_devices; i++) {
+    struct input_event ev[2];
+    memset(ev, 0, sizeof(ev));
+    ev[0].type = EV_KEY;
+    ev[0].code = KEY_A;
+    ev[0].value = 1;
+    ev[1].type = EV_SYN;
+    ev[1].code = SYN_REPORT;
+    if (write(pipes[i][1], ev, sizeof(ev)) != sizeof(ev)) {
+      fprintf(stderr, "error: failed to write to device %d: %m\n", i);
+      return 1;
+    }
+  }
+
+  for (int i = 0; i < 1000 && atomic_load(&num_events) < num_devices; i++)
+    sleep_ms(1);
+  if (atomic_load(&num_events) < num_devices) {
+    fprintf(stderr, "error: only %d of %d devices read their event\n",
+            atomic_load(&num_events), num_devices);
+    return 1;
+  }
+  sleep_ms(100);
+
+  long rss = rss_kb(0);
+
+  printf("%s: %d devices: first attached after %.1f us, all after %.1f us "
+         "(%.1f us each)\n",
+         BACKEND_NAME, num_devices, first_ns / 1000.0, all_ns / 1000.0,
+         all_ns / 1000.0 / num_devices);
+  printf("%s: rss %ld kB when idle, %ld kB with all devices (%.1f kB each)\n",
+         BACKEND_NAME, idle_rss, rss, (double)(rss - idle_rss) / num_devices);
+
+  /* Device threads are still blocked reading; exiting ends them */
+  return 0;
+}
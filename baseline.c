@@ -0,0 +1,167 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hist_kernel.h"
+
+#include "baseline.h"
+
+enum { num_baseline_slots = 7 * 24 };
+
+/* Each slot decays to this fraction of its weight over one week. */
+static const double baseline_decay_per_week = 0.75;
+
+static const double week_ms = 7 * 24 * 60 * 60 * 1000.0;
+
+/* Scores against slots lighter than this (in keys) are meaningless. */
+static const float baseline_min_weight = 200;
+
+static const char baseline_magic[8] = "QTBASE2";
+
+/*
+ * On-disk layout. Counts are exponentially decayed, so they are floats.
+ * The file is mapped, and a flush only touches one slot.
+ */
+struct baseline_file {
+  char magic[8];
+  uint32_t num_buckets;
+  uint32_t bucket_width_ms;
+
+  struct {
+    int64_t updated_ms; /* time of the last update, 0 if never */
+    float weight;       /* sum of bucket, as of updated_ms */
+    float bucket[num_buckets];
+  } slot[num_baseline_slots];
+};
+
+static struct baseline_file *baseline;
+
+int baseline_init(void) {
+  char *dir = getenv("STATE_DIRECTORY");
+  char path[PATH_MAX];
+  struct stat st;
+
+  if (!dir || 0 == strcmp(dir, ""))
+    return 0; /* disabled */
+
+  if (snprintf(path, sizeof(path), "%s/baseline.bin", dir) >= sizeof(path)) {
+    fprintf(stderr, "error: failed to build baseline file path\n");
+    return 1;
+  }
+
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "error: failed to open baseline file %s: %m\n", path);
+    return 1;
+  }
+
+  if (0 != fstat(fd, &st)) {
+    fprintf(stderr, "error: failed to stat baseline file %s: %m\n", path);
+    goto err;
+  }
+
+  bool fresh = st.st_size != sizeof(struct baseline_file);
+  if (fresh && 0 != ftruncate(fd, 0)) {
+    fprintf(stderr, "error: failed to truncate baseline file %s: %m\n", path);
+    goto err;
+  }
+  if (fresh && 0 != ftruncate(fd, sizeof(struct baseline_file))) {
+    fprintf(stderr, "error: failed to size baseline file %s: %m\n", path);
+    goto err;
+  }
+
+  baseline = mmap(NULL, sizeof(struct baseline_file), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fd, 0);
+  if (baseline == MAP_FAILED) {
+    baseline = NULL;
+    fprintf(stderr, "error: failed to map baseline file %s: %m\n", path);
+    goto err;
+  }
+  close(fd);
+
+  if (0 != memcmp(baseline->magic, baseline_magic, sizeof(baseline_magic)) ||
+      baseline->num_buckets != num_buckets ||
+      baseline->bucket_width_ms != bucket_width_ms) {
+    if (!fresh)
+      fprintf(stderr, "warn: baseline file %s is incompatible, resetting\n",
+              path);
+    memset(baseline, 0, sizeof(struct baseline_file));
+    memcpy(baseline->magic, baseline_magic, sizeof(baseline_magic));
+    baseline->num_buckets = num_buckets;
+    baseline->bucket_width_ms = bucket_width_ms;
+  }
+
+  return 0;
+
+err:
+  close(fd);
+  return 1;
+}
+
+static int baseline_slot(const struct tm *t_local) {
+  return t_local->tm_wday * 24 + t_local->tm_hour;
+}
+
+/*
+ * slot_decay returns how much slot s has decayed from its last update until
+ * t_ms. Decay goes by time, not by updates: hours the user types in only
+ * now and then must not be remembered for longer.
+ */
+static double slot_decay(int s, int64_t t_ms) {
+  int64_t elapsed_ms = t_ms - baseline->slot[s].updated_ms;
+
+  if (baseline->slot[s].updated_ms == 0 || elapsed_ms <= 0)
+    return 1; /* Empty, or the clock went back */
+  return pow(baseline_decay_per_week, elapsed_ms / week_ms);
+}
+
+int baseline_score(const struct histogram *hist, int64_t t_ms,
+                   const struct tm *t_local, double *out) {
+  if (!baseline || hist->num_keys <= 0)
+    return 1;
+
+  int s = baseline_slot(t_local);
+  float weight = baseline->slot[s].weight;
+  if (weight * slot_decay(s, t_ms) < baseline_min_weight)
+    return 1;
+
+  /* Decay scales all buckets alike, so the (normalized) distance is the same */
+
+  double emd = hist_kernel_distance(hist->bucket, hist->num_keys,
+                                    baseline->slot[s].bucket, weight,
+                                    num_buckets);
+
+  *out = emd * bucket_width_ms;
+  return 0;
+}
+
+void baseline_update(const struct histogram *hist, int64_t t_ms,
+                     const struct tm *t_local) {
+  if (!baseline)
+    return;
+
+  int s = baseline_slot(t_local);
+  baseline->slot[s].weight = hist_kernel_scale_add(
+      baseline->slot[s].bucket, slot_decay(s, t_ms), hist->bucket,
+      num_buckets);
+  if (t_ms > baseline->slot[s].updated_ms)
+    baseline->slot[s].updated_ms = t_ms;
+
+  msync(baseline, sizeof(struct baseline_file), MS_ASYNC);
+}
+
+void baseline_fini(void) {
+  if (!baseline)
+    return;
+
+  munmap(baseline, sizeof(struct baseline_file));
+  baseline = NULL;
+}
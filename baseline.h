@@ -0,0 +1,36 @@
+#ifndef QUA_BASELINE_H
+#define QUA_BASELINE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "histogram.h"
+
+/*
+ * The baseline is the typical distribution of delays for each hour of the
+ * week. It lives in $STATE_DIRECTORY/baseline.bin, and is updated in place
+ * with every flushed interval. Without $STATE_DIRECTORY, it is disabled.
+ */
+
+/* baseline_init maps the baseline file. Returns 1 on error. */
+int baseline_init(void);
+
+/*
+ * baseline_score computes the earth mover's distance (in msec) between hist
+ * and the baseline of the hour of week containing t_local (which is t_ms,
+ * in msec since the epoch).
+ * Returns 0 on success, 1 if disabled or the baseline is too thin.
+ */
+int baseline_score(const struct histogram *hist, int64_t t_ms,
+                   const struct tm *t_local, double *out);
+
+/*
+ * baseline_update merges hist into the baseline of its hour of week, after
+ * decaying that by the time since its last update.
+ */
+void baseline_update(const struct histogram *hist, int64_t t_ms,
+                     const struct tm *t_local);
+
+void baseline_fini(void);
+
+#endif
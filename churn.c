@@ -0,0 +1,396 @@
+/*
+ * qt-churn is a stress test for device attach and detach. It runs the daemon
+ * on a directory of fake (FIFO) devices, replaces them at a high rate, and
+ * then checks that
+ *
+ * - every device still attached gets all its keys counted,
+ * - file descriptors and RSS did not grow during the churn,
+ * - the enqueue-to-dequeue latency ("q") stayed bounded,
+ * - all file descriptors are released once all devices are gone.
+ *
+ * Usage: qt-churn [-n churns] [-d devices] [-k keys] [-l max_latency_ms]
+ *                 [-s seed] daemon
+ *
+ * Exits with 0 if all checks pass, 1 otherwise.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/input.h>
+
+#include "qtjournal.h"
+#include "test_util.h"
+#include "util.h"
+
+/* KEY_A */
+static const int key_code = 30;
+
+/* RSS may grow by this much during the churn (allocator noise) */
+static const long max_rss_growth_kb = 1024;
+
+static char input_dir[] = "/tmp/qt-churn-input-XXXXXX";
+static char staging_dir[] = "/tmp/qt-churn-staging-XXXXXX";
+static char logs_dir[] = "/tmp/qt-churn-logs-XXXXXX";
+
+static pid_t daemon_pid;
+
+/* count_fds returns the number of open file descriptors of the daemon. */
+static int count_fds(void) {
+  char path[64];
+  struct dirent *ent;
+  int n = 0;
+
+  snprintf(path, sizeof(path), "/proc/%d/fd", (int)daemon_pid);
+  DIR *dir = opendir(path);
+  if (!dir)
+    return -1;
+  while ((ent = readdir(dir)))
+    if (ent->d_name[0] != '.')
+      n++;
+  closedir(dir);
+  return n;
+}
+
+static int write_key(int fd) {
+  struct input_event ev[2];
+
+  memset(ev, 0, sizeof(ev));
+  ev[0].type = EV_KEY;
+  ev[0].code = key_code;
+  ev[0].value = 1;
+  ev[1] = ev[0];
+  ev[1].value = 0;
+
+  return write(fd, ev, sizeof(ev)) == sizeof(ev) ? 0 : 1;
+}
+
+/*
+ * attach creates a FIFO named name, and moves it into the input directory
+ * with its writer already open, so the daemon sees IN_MOVED_TO and never
+ * blocks on it. Returns the writer, or -1.
+ */
+static int attach(const char *name, int seq) {
+  char tmp[PATH_MAX];
+  char path[PATH_MAX];
+
+  snprintf(tmp, sizeof(tmp), "%s/f%d", staging_dir, seq);
+  snprintf(path, sizeof(path), "%s/%s", input_dir, name);
+
+  if (0 != mkfifo(tmp, 0600)) {
+    fprintf(stderr, "error: failed to create %s: %m\n", tmp);
+    return -1;
+  }
+
+  /* O_RDWR doesn't wait for a reader */
+  int fd = open(tmp, O_RDWR);
+  if (fd < 0) {
+    fprintf(stderr, "error: failed to open %s: %m\n", tmp);
+    unlink(tmp);
+    return -1;
+  }
+
+  if (0 != rename(tmp, path)) {
+    fprintf(stderr, "error: failed to rename %s: %m\n", tmp);
+    close(fd);
+    unlink(tmp);
+    return -1;
+  }
+
+  return fd;
+}
+
+static void detach(const char *name, int fd) {
+  char path[PATH_MAX];
+
+  snprintf(path, sizeof(path), "%s/%s", input_dir, name);
+  unlink(path);
+  close(fd);
+}
+
+static int spawn_daemon(const char *daemon) {
+  daemon_pid = fork();
+  if (daemon_pid < 0) {
+    fprintf(stderr, "error: failed to fork: %m\n");
+    return 1;
+  }
+
+  if (daemon_pid == 0) {
+    setenv("INPUT_DIRECTORY", input_dir, 1);
+    setenv("LOGS_DIRECTORY", logs_dir, 1);
+    setenv("INTERVAL", "1", 1);
+    setenv("QUEUE_LATENCY", "1", 1);
+    unsetenv("STATE_DIRECTORY");
+    unsetenv("WINDOWS");
+    unsetenv("GLOBAL_ORDER");
+    unsetenv("GROUP_BY");
+
+    /* Attach messages would drown out the results */
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0)
+      dup2(null_fd, STDERR_FILENO);
+
+    execl(daemon, daemon, (char *)NULL);
+    _exit(127);
+  }
+
+  return 0;
+}
+
+static void stop_daemon(void) {
+  if (daemon_pid <= 0)
+    return;
+  kill(daemon_pid, SIGTERM);
+  waitpid(daemon_pid, NULL, 0);
+  daemon_pid = 0;
+}
+
+/* remove_dir removes dir and the files in it. */
+static void remove_dir(const char *dir) {
+  char path[PATH_MAX];
+  struct dirent *ent;
+
+  DIR *d = opendir(dir);
+  if (d) {
+    while ((ent = readdir(d))) {
+      if (ent->d_name[0] == '.')
+        continue;
+      snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+      unlink(path);
+    }
+    closedir(d);
+  }
+  rmdir(dir);
+}
+
+/*
+ * max_latency_us returns the largest queue latency bucket (upper bound, in
+ * usec) of rec's "q" field, INT64_MAX for the overflow bucket, or 0.
+ */
+static int64_t max_latency_us(const struct qtj_record *rec) {
+  const char *value;
+  size_t len;
+  const char *pos = NULL;
+  struct qtj_kv kv;
+  int64_t max = 0;
+
+  if (0 != qtj_field(rec, "q", &value, &len))
+    return 0;
+
+  while (1 == qtj_next_count(value, len, &pos, &kv)) {
+    int64_t bucket = kv.key_len == 3 && 0 == memcmp(kv.key, "inf", 3)
+                         ? INT64_MAX
+                         : strtoll(kv.key, NULL, 10);
+    if (bucket > max)
+      max = bucket;
+  }
+
+  return max;
+}
+
+/*
+ * read_journal sums the keys of all interval records from since_ms on, and
+ * finds their largest queue latency. Returns 1 on error.
+ */
+static int read_journal(int64_t since_ms, int64_t *keys, int64_t *latency_us) {
+  char path[PATH_MAX];
+  struct qtj_journal journal;
+  struct qtj_iter it;
+  struct qtj_record rec;
+
+  *keys = 0;
+  *latency_us = 0;
+
+  snprintf(path, sizeof(path), "%s/typing.log", logs_dir);
+  if (0 != qtj_open(&journal, path)) {
+    fprintf(stderr, "error: failed to open %s: %m\n", path);
+    return 1;
+  }
+
+  qtj_iter_init(&it, &journal);
+  qtj_seek(&it, since_ms);
+  while (qtj_next(&it, &rec)) {
+    if (rec.window_sec != 0 || rec.group)
+      continue;
+    *keys += rec.num_keys;
+    int64_t us = max_latency_us(&rec);
+    if (us > *latency_us)
+      *latency_us = us;
+  }
+
+  qtj_close(&journal);
+  return 0;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-n churns] [-d devices] [-k keys] [-l max_latency_ms] "
+          "[-s seed] daemon\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  int num_churns = 2000;
+  int num_devices = 16;
+  int num_keys = 10;
+  long max_latency_ms = 100;
+  unsigned seed = 1;
+  int rc = 1; /* Failure */
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:d:k:l:s:h")) != -1) {
+    switch (opt) {
+    case 'n':
+      num_churns = atoi(optarg);
+      break;
+    case 'd':
+      num_devices = atoi(optarg);
+      break;
+    case 'k':
+      num_keys = atoi(optarg);
+      break;
+    case 'l':
+      max_latency_ms = atol(optarg);
+      break;
+    case 's':
+      seed = strtoul(optarg, NULL, 10);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind != argc - 1 || num_churns < 1 || num_devices < 1 ||
+      num_keys < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  /* A detached device's writer must not kill us */
+  signal(SIGPIPE, SIG_IGN);
+  srand(seed);
+
+  int *writer = malloc(num_devices * sizeof(*writer));
+  if (!writer) {
+    fprintf(stderr, "error: %m\n");
+    return 1;
+  }
+  for (int i = 0; i < num_devices; i++)
+    writer[i] = -1;
+
+  if (!mkdtemp(input_dir) || !mkdtemp(staging_dir) || !mkdtemp(logs_dir)) {
+    fprintf(stderr, "error: failed to create directories: %m\n");
+    goto out_1;
+  }
+
+  if (0 != spawn_daemon(argv[optind]))
+    goto out_2;
+  sleep_ms(300);
+
+  int idle_fds = count_fds();
+  int churn_fds = -1;
+  long churn_rss = -1;
+
+  for (int i = 0; i < num_churns; i++) {
+    char name[32];
+    int d = rand() % num_devices;
+
+    snprintf(name, sizeof(name), "event%d", d);
+    if (writer[d] >= 0)
+      detach(name, writer[d]);
+
+    writer[d] = attach(name, i);
+    if (writer[d] < 0 || 0 != write_key(writer[d]))
+      goto out_3;
+
+    /* Baseline, once all devices have been attached at least once */
+    if (i == num_churns / 10) {
+      sleep_ms(500);
+      churn_fds = count_fds();
+      churn_rss = rss_kb(daemon_pid);
+    }
+  }
+
+  /* Let the churn's keys be written out, and the interval close */
+  sleep_ms(2500);
+
+  int num_live = 0;
+  int64_t since_ms = realtime_ms();
+  since_ms -= since_ms % 1000;
+  for (int d = 0; d < num_devices; d++) {
+    if (writer[d] < 0)
+      continue;
+    num_live++;
+    for (int k = 0; k < num_keys; k++)
+      if (0 != write_key(writer[d]))
+        goto out_3;
+  }
+
+  /* Interval end, plus grace, plus some slack */
+  sleep_ms(2500);
+
+  int fds = count_fds();
+  long rss = rss_kb(daemon_pid);
+
+  int64_t keys;
+  int64_t latency_us;
+  if (0 != read_journal(since_ms, &keys, &latency_us))
+    goto out_3;
+
+  for (int d = 0; d < num_devices; d++) {
+    char name[32];
+    snprintf(name, sizeof(name), "event%d", d);
+    if (writer[d] >= 0)
+      detach(name, writer[d]);
+    writer[d] = -1;
+  }
+  sleep_ms(500);
+  int detached_fds = count_fds();
+
+  bool keys_ok = keys == (int64_t)num_live * num_keys;
+  bool fds_ok = fds == churn_fds && detached_fds == idle_fds;
+  bool rss_ok = rss - churn_rss <= max_rss_growth_kb;
+  bool latency_ok = latency_us <= max_latency_ms * 1000;
+
+  printf("devices: %d live, %" PRId64 "/%d keys counted: %s\n", num_live, keys,
+         num_live * num_keys, keys_ok ? "ok" : "FAIL");
+  printf("fds: %d idle, %d during churn, %d after, %d detached: %s\n",
+         idle_fds, churn_fds, fds, detached_fds, fds_ok ? "ok" : "FAIL");
+  printf("rss: %ld kB during churn, %ld kB after: %s\n", churn_rss, rss,
+         rss_ok ? "ok" : "FAIL");
+  if (latency_us == INT64_MAX)
+    printf("queue latency: overflow bucket: FAIL\n");
+  else
+    printf("queue latency: < %" PRId64 " us: %s\n", latency_us,
+           latency_ok ? "ok" : "FAIL");
+
+  if (keys_ok && fds_ok && rss_ok && latency_ok)
+    rc = 0; /* Success */
+
+out_3:
+  for (int d = 0; d < num_devices; d++)
+    if (writer[d] >= 0)
+      close(writer[d]);
+  stop_daemon();
+out_2:
+  remove_dir(input_dir);
+  remove_dir(staging_dir);
+  remove_dir(logs_dir);
+out_1:
+  free(writer);
+  return rc;
+}
@@ -17,6 +17,9 @@ struct entry {
   LIST_ENTRY(entry) entries;
 
   char *name;
+
+  /* readded is set if name was added again while present. */
+  bool readded;
 } * dev_list;
 
 /* Not thread-safe! */
@@ -24,7 +27,7 @@ void dev_input_set_init(void) { LIST_INIT(&head); }
 
 /*
  * Add string to set.
- * If already present, do nothing.
+ * If already present, only remember that it was added again.
  * Return 0 if it was newly added, 1 otherwise.
  * Thread-safe.
  * Can wait on mutex.
@@ -52,6 +55,7 @@ int dev_input_set_add(char *name) {
   for (np = head.lh_first; np != NULL; np = np->entries.le_next) {
     if (0 == strcmp(e->name, np->name)) {
       was_already_present = true;
+      np->readded = true;
       break;
     }
   }
@@ -79,16 +83,20 @@ err_1:
 /*
  * Remove string from set.
  * If not present, do nothing.
+ * Return 1 if it was added again while present, 0 otherwise.
  * Thread-safe.
  * Can wait on mutex.
  * Operation is O(n) - set is assumed to be small!
  */
-void dev_input_set_remove(char *name) {
+int dev_input_set_remove(char *name) {
+  int readded = 0;
+
   pthread_mutex_lock(&lock);
 
   struct entry *np;
   for (np = head.lh_first; np != NULL; np = np->entries.le_next) {
     if (0 == strcmp(name, np->name)) {
+      readded = np->readded;
       LIST_REMOVE(np, entries);
       free(np->name);
       free(np);
@@ -97,4 +105,6 @@ void dev_input_set_remove(char *name) {
   }
 
   pthread_mutex_unlock(&lock);
+
+  return readded;
 }
@@ -0,0 +1,191 @@
+#include <limits.h>
+#include <pthread.h>
+#include <regex.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sysmacros.h>
+
+#include "device_group.h"
+
+enum device_group_by {
+  DEVICE_GROUP_BY_NONE,
+  DEVICE_GROUP_BY_SEAT,
+  DEVICE_GROUP_BY_NAME,
+  DEVICE_GROUP_BY_PHYS,
+};
+
+static struct {
+  enum device_group_by by;
+
+  bool have_pattern;
+  regex_t pattern;
+
+  /* lock protects the registry below. */
+  pthread_mutex_t lock;
+
+  /* name[id] is the name of group id. Only ever appended to. */
+  char **name;
+  int num_names;
+  int cap_names;
+} device_group_data = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+int device_group_init(void) {
+  char *by = getenv("GROUP_BY");
+  char *pattern = getenv("GROUP_PATTERN");
+
+  if (!by || 0 == strcmp(by, ""))
+    return 0; /* disabled */
+
+  if (0 == strcmp(by, "seat")) {
+    device_group_data.by = DEVICE_GROUP_BY_SEAT;
+  } else if (0 == strcmp(by, "name")) {
+    device_group_data.by = DEVICE_GROUP_BY_NAME;
+  } else if (0 == strcmp(by, "phys")) {
+    device_group_data.by = DEVICE_GROUP_BY_PHYS;
+  } else {
+    fprintf(stderr, "error: bad group by: %s. must be seat, name or phys.\n",
+            by);
+    return 1;
+  }
+
+  if (pattern && 0 != strcmp(pattern, "")) {
+    int rc = regcomp(&device_group_data.pattern, pattern, REG_EXTENDED);
+    if (0 != rc) {
+      char errbuf[1024]; // NOLINT(readability-magic-numbers)
+      regerror(rc, &device_group_data.pattern, errbuf, sizeof(errbuf));
+      fprintf(stderr, "error: failed to compile group pattern: %s\n", errbuf);
+      return 1;
+    }
+    device_group_data.have_pattern = true;
+  }
+
+  return 0;
+}
+
+/* read_seat looks up the ID_SEAT udev property of devnum; seat0 if unset. */
+static void read_seat(dev_t devnum, char *out, size_t out_len) {
+  char path[PATH_MAX];
+  char line[256]; // NOLINT(readability-magic-numbers)
+  static const char prefix[] = "E:ID_SEAT=";
+
+  snprintf(out, out_len, "seat0");
+
+  if (!devnum)
+    return;
+
+  snprintf(path, sizeof(path), "/run/udev/data/c%u:%u", major(devnum),
+           minor(devnum));
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return;
+
+  while (fgets(line, sizeof(line), f)) {
+    if (0 == strncmp(line, prefix, sizeof(prefix) - 1)) {
+      line[strcspn(line, "\n")] = '\0';
+      snprintf(out, out_len, "%s", line + sizeof(prefix) - 1);
+      break;
+    }
+  }
+
+  fclose(f);
+}
+
+/* device_group_key computes the group name of dev. Returns 1 if none. */
+static int device_group_key(struct input_device *dev, char *out,
+                            size_t out_len) {
+  const char *attr;
+  char seat[256]; // NOLINT(readability-magic-numbers)
+
+  switch (device_group_data.by) {
+  case DEVICE_GROUP_BY_SEAT:
+    read_seat(input_device_get_devnum(dev), seat, sizeof(seat));
+    attr = seat;
+    break;
+  case DEVICE_GROUP_BY_NAME:
+    attr = input_device_get_name(dev);
+    break;
+  case DEVICE_GROUP_BY_PHYS:
+    /* Interfaces of one device share the part before the first '/' */
+    attr = input_device_get_phys(dev);
+    break;
+  default:
+    return 1;
+  }
+
+  if (!attr)
+    attr = "";
+
+  if (!device_group_data.have_pattern) {
+    size_t len = strlen(attr);
+    if (device_group_data.by == DEVICE_GROUP_BY_PHYS)
+      len = strcspn(attr, "/");
+    snprintf(out, out_len, "%.*s", (int)len, attr);
+    return 0;
+  }
+
+  regmatch_t match[2];
+  if (0 != regexec(&device_group_data.pattern, attr, 2, match, 0))
+    return 1; /* Not in any group */
+
+  regmatch_t *m = match[1].rm_so >= 0 ? &match[1] : &match[0];
+  snprintf(out, out_len, "%.*s", (int)(m->rm_eo - m->rm_so), attr + m->rm_so);
+  return 0;
+}
+
+int device_group_attach(struct input_device *dev) {
+  char key[256]; // NOLINT(readability-magic-numbers)
+  int id = -1;
+
+  if (device_group_data.by == DEVICE_GROUP_BY_NONE)
+    return -1;
+
+  if (0 != device_group_key(dev, key, sizeof(key)))
+    return -1;
+
+  pthread_mutex_lock(&device_group_data.lock);
+
+  /* O(n), but only once per attach */
+  for (int i = 0; i < device_group_data.num_names; i++) {
+    if (0 == strcmp(key, device_group_data.name[i])) {
+      id = i;
+      goto out;
+    }
+  }
+
+  if (device_group_data.num_names == device_group_data.cap_names) {
+    int cap =
+        device_group_data.cap_names ? 2 * device_group_data.cap_names : 16;
+    char **name = realloc(device_group_data.name, cap * sizeof(*name));
+    if (!name) {
+      fprintf(stderr, "error: %m\n");
+      goto out;
+    }
+    device_group_data.name = name;
+    device_group_data.cap_names = cap;
+  }
+
+  char *name = strdup(key);
+  if (!name) {
+    fprintf(stderr, "error: %m\n");
+    goto out;
+  }
+
+  id = device_group_data.num_names++;
+  device_group_data.name[id] = name;
+
+out:
+  pthread_mutex_unlock(&device_group_data.lock);
+  return id;
+}
+
+const char *device_group_name(int id) {
+  pthread_mutex_lock(&device_group_data.lock);
+  const char *name = device_group_data.name[id];
+  pthread_mutex_unlock(&device_group_data.lock);
+
+  return name;
+}
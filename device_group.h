@@ -0,0 +1,27 @@
+#ifndef QUA_DEVICE_GROUP_H
+#define QUA_DEVICE_GROUP_H
+
+#include "input_device.h"
+
+/*
+ * Devices can be grouped (e.g. by seat, on terminal servers), to get one
+ * distribution per group in addition to the global one.
+ * Set via $GROUP_BY: "seat" (udev ID_SEAT), "name" or "phys".
+ * $GROUP_PATTERN optionally is a regex applied to that attribute; its first
+ * subexpression (or the whole match) is the group, non-matching devices
+ * are not grouped.
+ */
+
+/* device_group_init reads the configuration. Returns 1 on error. */
+int device_group_init(void);
+
+/*
+ * device_group_attach returns the group id of dev (0, 1, ...), or -1 if
+ * grouping is disabled or dev does not belong to a group. Thread-safe.
+ */
+int device_group_attach(struct input_device *dev);
+
+/* device_group_name returns the name of group id. Thread-safe. */
+const char *device_group_name(int id);
+
+#endif
@@ -9,11 +9,14 @@
 #include <time.h>
 #include <unistd.h>
 
-#include <libevdev/libevdev.h>
 #include <linux/input-event-codes.h>
 #include <linux/input.h>
 
 #include "dev_input_set.h"
+#include "device_group.h"
+#include "input_device.h"
+#include "key_class.h"
+#include "probes.h"
 #include "stats_thread.h"
 #include "util.h"
 
@@ -21,8 +24,14 @@
 
 struct device_thread_data {
 	char *path;
-	struct libevdev *dev;
+	struct input_device *dev;
 	struct timespec last_time_mono;
+
+	/* Event timestamps are CLOCK_MONOTONIC (only set in global order mode) */
+	bool kernel_time_mono;
+
+	/* Group of the device, or -1 (see device_group.h) */
+	int group;
 };
 
 static void device_thread_data_free(struct device_thread_data *h)
@@ -31,33 +40,36 @@ static void device_thread_data_free(struct device_thread_data *h)
 		return;
 	}
 
-	/*
-	 * libevdev doesn't manage fd's, it only uses them.
-	 * So up to us to close it.
-	 */
-	if (h->dev) {
-		int fd = libevdev_get_fd(h->dev);
-		if (fd >= 0) {
-			close(fd);
-		}
-	}
-
-	libevdev_free(h->dev);
-
-	/*
-	 * Device was added to set before thread was spawned to prevent connecting twice.
-	 * We're disconnected now, so we can remove it again, in case it re-appears.
-	 * Bug: this is racy - if it reappears too fast, we will miss it. ¯\_(ツ)_/¯
-	 */
-	dev_input_set_remove(h->path);
+	input_device_free(h->dev);
 
 	free(h->path);
 	free(h);
 }
 
+static int device_thread_start(char *path);
+
+/*
+ * Device was added to set before thread was spawned to prevent connecting twice.
+ * We're disconnected now (or failed to connect), so we can remove it again,
+ * in case it re-appears. If it already re-appeared in the meantime, the set
+ * remembered that, and we start a new thread for it. That can fail too (and
+ * the device re-appear again meanwhile), hence the loop.
+ */
+static void device_thread_release(char *path)
+{
+	while (dev_input_set_remove(path)) {
+		if (0 != dev_input_set_add(path)) {
+			return; /* Error, or someone else is handling it now */
+		}
+		if (0 == device_thread_start(path)) {
+			return; /* Attached again */
+		}
+	}
+}
+
 static void device_thread_handle_event(struct device_thread_data *thread, const struct input_event *event)
 {
-	if (!libevdev_event_is_type(event, EV_KEY)) {
+	if (event->type != EV_KEY) {
 		return;
 	}
 
@@ -66,6 +78,22 @@ static void device_thread_handle_event(struct device_thread_data *thread, const
 		return;
 	}
 
+	/* Only the class of the key is passed on, never the key itself. */
+	enum key_class key_class = key_class_of(event->code);
+
+	/*
+	 * In global order mode, the stats thread computes delays across devices,
+	 * ordered by the kernel's timestamps.
+	 */
+	if (thread->kernel_time_mono) {
+		struct timespec press_time = {
+			.tv_sec = event->input_event_sec,
+			.tv_nsec = event->input_event_usec * 1000,
+		};
+		stats_thread_submit_key_at(&press_time, key_class, thread->group);
+		return;
+	}
+
 	struct timespec cur_time;
 	clock_gettime(CLOCK_MONOTONIC, &cur_time);
 
@@ -84,70 +112,74 @@ static void device_thread_handle_event(struct device_thread_data *thread, const
 
 	clock_gettime(CLOCK_MONOTONIC, &thread->last_time_mono);
 
-	stats_thread_submit_key(&cur_time, &delta_time);
+	if (stats_thread_global_order()) {
+		/* Kernel can't give us CLOCK_MONOTONIC timestamps; use our own. */
+		stats_thread_submit_key_at(&cur_time, key_class, thread->group);
+		return;
+	}
+
+	stats_thread_submit_key(&cur_time, &delta_time, key_class, thread->group);
 }
 
 static void *device_thread(void *arg)
 {
 	struct device_thread_data *thread = (struct device_thread_data *)arg;
 	struct input_event event;
-	int rc;
-
-	fprintf(stderr, "info: attached to %s (%s)\n", thread->path, libevdev_get_name(thread->dev));
 
-	do {
-		rc = libevdev_next_event(
-				thread->dev,
-				LIBEVDEV_READ_FLAG_NORMAL | LIBEVDEV_READ_FLAG_BLOCKING,
-				&event);
+	fprintf(stderr, "info: attached to %s (%s)\n", thread->path, input_device_get_name(thread->dev));
 
-		if (rc == LIBEVDEV_READ_STATUS_SUCCESS) {
-			device_thread_handle_event(thread, &event);
-		}
-
-	} while (rc == LIBEVDEV_READ_STATUS_SYNC
-			|| rc == LIBEVDEV_READ_STATUS_SUCCESS
-			|| rc == -EAGAIN);
+	while (0 == input_device_next_event(thread->dev, &event)) {
+		QUA_PROBE3(device_read, event.type, event.code, event.value);
+		device_thread_handle_event(thread, &event);
+	}
 
+	char *path = thread->path;
+	thread->path = NULL;
 	device_thread_data_free(thread);
 
+	device_thread_release(path);
+	free(path);
+
 	return NULL;
 }
 
-void spawn_device_thread(char *path)
+/*
+ * device_thread_start attaches to path, which must already be in the set.
+ * Returns 0 if attached, 1 otherwise. Doesn't remove path from the set.
+ */
+static int device_thread_start(char *path)
 {
-	/* Prevent spawning multiple threads for same path */
-	if (0 != dev_input_set_add(path)) {
-		return; /* Error, or already being handled */
-	}
-
-	int fd = open(path, O_RDONLY);
-	if (fd < 0) {
-		fprintf(stderr, "error: failed to open %s\n", path);
-		return;
-		goto err_1;
-	}
-
 	struct device_thread_data *thread = calloc(sizeof(*thread), 1);
 	if (!thread) {
 		fprintf(stderr, "error: %m\n");
-		goto err_2;
+		goto err_1;
 	}
 
 	thread->path = strdup(path);
 	if (!thread->path) {
 		fprintf(stderr, "error: %m\n");
-		goto err_3;
+		goto err_2;
 	}
 
-	if (libevdev_new_from_fd(fd, &thread->dev) < 0) {
-		fprintf(stderr, "error: failed to init libevdev dev: %m\n");
-		goto err_3;
+	if (0 != input_device_open(path, &thread->dev)) {
+		goto err_2;
 	}
 
 	/* Not a keyboard? */
-	if (!libevdev_has_event_type(thread->dev, EV_KEY)) {
-		goto err_3;
+	if (!input_device_has_keys(thread->dev)) {
+		goto err_2;
+	}
+
+	/* Grouping is decided once, so it costs nothing per key. */
+	thread->group = device_group_attach(thread->dev);
+
+	/* Global order mode compares timestamps of different devices. */
+	if (stats_thread_global_order()) {
+		if (0 == input_device_set_clock_monotonic(thread->dev)) {
+			thread->kernel_time_mono = true;
+		} else {
+			fprintf(stderr, "warn: failed to set clock of %s\n", path);
+		}
 	}
 
 	/* Initialize the pthread attribute object */
@@ -155,35 +187,46 @@ void spawn_device_thread(char *path)
 	errno = pthread_attr_init(&pthread_attr);
 	if (0 != errno) {
 		fprintf(stderr, "error: failed to initialize pthread_attr_t: %m\n");
-		goto err_3;
+		goto err_2;
 	}
 
 	/* Since no return value is required, create detached threads. */
 	errno = pthread_attr_setdetachstate(&pthread_attr, PTHREAD_CREATE_DETACHED);
 	if (0 != errno) {
 		fprintf(stderr, "error: failed to set thread detached state: %m\n");
-		goto err_4;
+		goto err_3;
 	}
 
 	pthread_t tid;
 	errno = pthread_create(&tid, &pthread_attr, device_thread, thread);
 	if (0 != errno) {
 		fprintf(stderr, "error: failed to create thread: %m\n");
-		goto err_4;
+		goto err_3;
 	}
 
 	pthread_attr_destroy(&pthread_attr);
 
-	return; /* Success */
+	return 0; /* Success */
 
-err_4:
-	pthread_attr_destroy(&pthread_attr);
 err_3:
-	device_thread_data_free(thread);
+	pthread_attr_destroy(&pthread_attr);
 err_2:
-	close(fd);
+	device_thread_data_free(thread);
 err_1:
-	return; /* Error */
+	return 1; /* Error */
 }
 
+void spawn_device_thread(char *path)
+{
+	/* Prevent spawning multiple threads for same path */
+	if (0 != dev_input_set_add(path)) {
+		return; /* Error, or already being handled */
+	}
+
+	if (0 == device_thread_start(path)) {
+		return; /* Success */
+	}
 
+	device_thread_release(path);
+	return; /* Error */
+}
@@ -0,0 +1,284 @@
+/*
+ * quantified-typing-heatmap renders a year of journal lines as a day x hour
+ * heatmap of typing activity (keys) and median delay, as SVG.
+ *
+ * Usage: quantified-typing-heatmap [-y year] [-o out.svg] [-r out.raw] journal
+ *
+ * The raw dump is the merged matrix as native int32,
+ * [366 days][24 hours][num_buckets buckets].
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hist_kernel.h"
+#include "histogram.h"
+#include "qtjournal.h"
+
+enum {
+  num_days = 366,
+  num_hours = 24,
+};
+
+/* Layout of the SVG, in pixels */
+enum {
+  cell_width = 3,
+  cell_height = 12,
+  margin_left = 40,
+  margin_top = 30,
+  panel_height = num_hours * cell_height + 2 * margin_top,
+  image_width = margin_left + num_days * cell_width + 10,
+};
+
+/* Delays at or above this are drawn in the darkest median color */
+static const int median_max_ms = 400;
+
+/* cell[d][h] is the merged distribution of hour h on day d of the year. */
+static int32_t cell[num_days][num_hours][num_buckets];
+static int32_t cell_keys[num_days][num_hours];
+
+static const int days_before_month[12] = {0,   31,  59,  90,  120, 151,
+                                          181, 212, 243, 273, 304, 334};
+
+static bool is_leap_year(int year) {
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+/* parse_uint parses decimal digits at *p, advancing *p. */
+static int parse_uint(const char **p, const char *end) {
+  int v = 0;
+  while (*p < end && **p >= '0' && **p <= '9') {
+    v = v * 10 + (**p - '0');
+    (*p)++;
+  }
+  return v;
+}
+
+/*
+ * parse_local parses "YYYY-MM-DD HH:MM:SS" into year, day of year and hour.
+ * Uses the "l" field rather than localtime(), which is much slower.
+ */
+static int parse_local(const char *p, const char *end, int *year, int *yday,
+                       int *hour) {
+  if (end - p < 13 || p[4] != '-' || p[7] != '-' || p[10] != ' ')
+    return 1;
+
+  const char *q = p;
+  *year = parse_uint(&q, end);
+  q = p + 5;
+  int month = parse_uint(&q, end);
+  q = p + 8;
+  int mday = parse_uint(&q, end);
+  q = p + 11;
+  *hour = parse_uint(&q, end);
+
+  if (month < 1 || month > 12 || mday < 1 || mday > 31 || *hour > 23)
+    return 1;
+
+  *yday = days_before_month[month - 1] + mday - 1;
+  if (month > 2 && is_leap_year(*year))
+    (*yday)++;
+  return 0;
+}
+
+/*
+ * merge_record merges one record into the matrix, if it is an interval of
+ * the given year. Sliding windows overlap intervals, and group records are
+ * already counted in the interval's record, so both are skipped.
+ */
+static void merge_record(const struct qtj_record *rec, int year) {
+  int rec_year, yday, hour;
+
+  if (rec->window_sec != 0 || rec->group || !rec->local)
+    return;
+  if (parse_local(rec->local, rec->local + rec->local_len, &rec_year, &yday,
+                  &hour))
+    return;
+  if (rec_year != year)
+    return;
+
+  /* Lines hold only the buckets with keys, so those are scattered */
+  int32_t *hist = cell[yday][hour];
+  for (int i = 0; i < rec->num_pairs; i++)
+    hist[rec->pair[i].bucket] += rec->pair[i].count;
+  cell_keys[yday][hour] += rec->num_keys;
+}
+
+static int parse_journal(const char *path, int year) {
+  struct qtj_journal journal;
+  struct qtj_iter it;
+  struct qtj_record rec;
+
+  if (0 != qtj_open(&journal, path)) {
+    fprintf(stderr, "error: failed to open %s: %m\n", path);
+    return 1;
+  }
+
+  qtj_iter_init(&it, &journal);
+  while (qtj_next(&it, &rec))
+    merge_record(&rec, year);
+
+  if (it.malformed)
+    fprintf(stderr, "warn: skipped %zu malformed lines\n", it.malformed);
+
+  qtj_close(&journal);
+  return 0;
+}
+
+/* median_ms returns the lower bound of the bucket holding the median. */
+static int median_ms(const int32_t *hist, int32_t keys) {
+  return hist_kernel_percentile(hist, keys, 0.5, num_buckets) *
+         bucket_width_ms;
+}
+
+static int channel_mix(uint32_t a, uint32_t b, int shift, double f) {
+  int ca = (a >> shift) & 0xff;
+  int cb = (b >> shift) & 0xff;
+  return ca + f * (cb - ca);
+}
+
+/* color_mix writes an #rrggbb color between a (f = 0) and b (f = 1). */
+static void color_mix(char *out, size_t out_len, uint32_t a, uint32_t b,
+                      double f) {
+  if (f < 0)
+    f = 0;
+  if (f > 1)
+    f = 1;
+
+  snprintf(out, out_len, "#%02x%02x%02x", channel_mix(a, b, 16, f),
+           channel_mix(a, b, 8, f), channel_mix(a, b, 0, f));
+}
+
+static void write_panel(FILE *out, int year, int y0, const char *title,
+                        bool median) {
+  char color[8];
+  int32_t max_keys = 1;
+
+  for (int d = 0; d < num_days; d++)
+    for (int h = 0; h < num_hours; h++)
+      if (cell_keys[d][h] > max_keys)
+        max_keys = cell_keys[d][h];
+
+  fprintf(out, "<text x=\"%d\" y=\"%d\">%d: %s</text>\n", margin_left,
+          y0 + margin_top - 10, year, title);
+
+  for (int h = 0; h < num_hours; h += 3)
+    fprintf(out, "<text x=\"5\" y=\"%d\" font-size=\"10\">%02d:00</text>\n",
+            y0 + margin_top + h * cell_height + cell_height - 2, h);
+
+  for (int d = 0; d < num_days; d++) {
+    for (int h = 0; h < num_hours; h++) {
+      int32_t keys = cell_keys[d][h];
+      if (keys <= 0)
+        continue;
+
+      if (median)
+        color_mix(color, sizeof(color), 0xffffcc, 0x800026,
+                  (double)median_ms(cell[d][h], keys) / median_max_ms);
+      else
+        color_mix(color, sizeof(color), 0xedf8e9, 0x006d2c,
+                  log1p(keys) / log1p(max_keys));
+
+      fprintf(out,
+              "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" "
+              "fill=\"%s\"/>\n",
+              margin_left + d * cell_width, y0 + margin_top + h * cell_height,
+              cell_width, cell_height, color);
+    }
+  }
+}
+
+static int write_svg(const char *path, int year) {
+  FILE *out = path ? fopen(path, "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "error: failed to open %s: %m\n", path);
+    return 1;
+  }
+
+  fprintf(out,
+          "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" "
+          "height=\"%d\" font-family=\"sans-serif\" font-size=\"12\" "
+          "shape-rendering=\"crispEdges\">\n",
+          image_width, 2 * panel_height);
+  write_panel(out, year, 0, "keys per hour", false);
+  write_panel(out, year, panel_height, "median delay", true);
+  fprintf(out, "</svg>\n");
+
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
+
+static int write_raw(const char *path) {
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    fprintf(stderr, "error: failed to open %s: %m\n", path);
+    return 1;
+  }
+
+  if (fwrite(cell, sizeof(cell), 1, out) != 1) {
+    fprintf(stderr, "error: failed to write %s: %m\n", path);
+    fclose(out);
+    return 1;
+  }
+
+  fclose(out);
+  return 0;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr, "usage: %s [-y year] [-o out.svg] [-r out.raw] journal\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  const char *svg_path = NULL;
+  const char *raw_path = NULL;
+  int year = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "y:o:r:h")) != -1) {
+    switch (opt) {
+    case 'y':
+      year = atoi(optarg);
+      break;
+    case 'o':
+      svg_path = optarg;
+      break;
+    case 'r':
+      raw_path = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (!year) {
+    time_t now = time(NULL);
+    struct tm now_local;
+    localtime_r(&now, &now_local);
+    year = now_local.tm_year + 1900;
+  }
+
+  if (0 != parse_journal(argv[optind], year))
+    return 1;
+
+  if (raw_path && 0 != write_raw(raw_path))
+    return 1;
+
+  if (0 != write_svg(svg_path, year))
+    return 1;
+
+  return 0;
+}
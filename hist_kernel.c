@@ -0,0 +1,190 @@
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HIST_KERNEL_X86
+#endif
+
+#include "hist_kernel.h"
+
+/*
+ * Element-wise kernels have one version per instruction set, selected once
+ * by hist_kernel_select(). Prefix sums (percentile, distance) are sequential
+ * by nature, and at ~200 buckets cost less than one cache miss, so those
+ * are plain loops everywhere.
+ *
+ * There is no dense add: the tools merge journal lines, which hold only the
+ * buckets that have keys, so they scatter those few counts (qtj_merge())
+ * rather than adding whole arrays.
+ */
+
+static void sub_u16_scalar(int32_t *dst, const uint16_t *src, int n) {
+  for (int i = 0; i < n; i++)
+    dst[i] -= src[i];
+}
+
+static float scale_add_scalar(float *dst, float scale, const int32_t *src,
+                              int n) {
+  float sum = 0;
+  for (int i = 0; i < n; i++) {
+    dst[i] = dst[i] * scale + (float)src[i];
+    sum += dst[i];
+  }
+  return sum;
+}
+
+#ifdef HIST_KERNEL_X86
+
+/* SSE2 */
+
+__attribute__((target("sse2"))) static void
+sub_u16_sse2(int32_t *dst, const uint16_t *src, int n) {
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i s = _mm_loadu_si128((const __m128i *)&src[i]);
+    __m128i d_lo = _mm_loadu_si128((const __m128i *)&dst[i]);
+    __m128i d_hi = _mm_loadu_si128((const __m128i *)&dst[i + 4]);
+    d_lo = _mm_sub_epi32(d_lo, _mm_unpacklo_epi16(s, zero));
+    d_hi = _mm_sub_epi32(d_hi, _mm_unpackhi_epi16(s, zero));
+    _mm_storeu_si128((__m128i *)&dst[i], d_lo);
+    _mm_storeu_si128((__m128i *)&dst[i + 4], d_hi);
+  }
+  sub_u16_scalar(&dst[i], &src[i], n - i);
+}
+
+__attribute__((target("sse2"))) static float
+scale_add_sse2(float *dst, float scale, const int32_t *src, int n) {
+  __m128 vscale = _mm_set1_ps(scale);
+  __m128 vsum = _mm_setzero_ps();
+  float sum[4];
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 s = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)&src[i]));
+    __m128 d = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&dst[i]), vscale), s);
+    _mm_storeu_ps(&dst[i], d);
+    vsum = _mm_add_ps(vsum, d);
+  }
+  _mm_storeu_ps(sum, vsum);
+  return sum[0] + sum[1] + sum[2] + sum[3] +
+         scale_add_scalar(&dst[i], scale, &src[i], n - i);
+}
+
+/* AVX2 */
+
+__attribute__((target("avx2"))) static void
+sub_u16_avx2(int32_t *dst, const uint16_t *src, int n) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i s =
+        _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)&src[i]));
+    __m256i d = _mm256_loadu_si256((const __m256i *)&dst[i]);
+    _mm256_storeu_si256((__m256i *)&dst[i], _mm256_sub_epi32(d, s));
+  }
+  sub_u16_scalar(&dst[i], &src[i], n - i);
+}
+
+__attribute__((target("avx2"))) static float
+scale_add_avx2(float *dst, float scale, const int32_t *src, int n) {
+  __m256 vscale = _mm256_set1_ps(scale);
+  __m256 vsum = _mm256_setzero_ps();
+  float sum[8];
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 s =
+        _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)&src[i]));
+    /* No FMA, so dst matches the other versions bit for bit */
+    __m256 d =
+        _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&dst[i]), vscale), s);
+    _mm256_storeu_ps(&dst[i], d);
+    vsum = _mm256_add_ps(vsum, d);
+  }
+  _mm256_storeu_ps(sum, vsum);
+  return sum[0] + sum[1] + sum[2] + sum[3] + sum[4] + sum[5] + sum[6] +
+         sum[7] + scale_add_scalar(&dst[i], scale, &src[i], n - i);
+}
+
+#endif
+
+static struct {
+  void (*sub_u16)(int32_t *dst, const uint16_t *src, int n);
+  float (*scale_add)(float *dst, float scale, const int32_t *src, int n);
+} hist_kernel = {
+    .sub_u16 = sub_u16_scalar,
+    .scale_add = scale_add_scalar,
+};
+
+int hist_kernel_use(enum hist_kernel_isa isa) {
+  switch (isa) {
+  case HIST_KERNEL_SCALAR:
+    hist_kernel.sub_u16 = sub_u16_scalar;
+    hist_kernel.scale_add = scale_add_scalar;
+    return 0;
+#ifdef HIST_KERNEL_X86
+  case HIST_KERNEL_SSE2:
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("sse2"))
+      return -1;
+    hist_kernel.sub_u16 = sub_u16_sse2;
+    hist_kernel.scale_add = scale_add_sse2;
+    return 0;
+  case HIST_KERNEL_AVX2:
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("avx2"))
+      return -1;
+    hist_kernel.sub_u16 = sub_u16_avx2;
+    hist_kernel.scale_add = scale_add_avx2;
+    return 0;
+#endif
+  default:
+    return -1;
+  }
+}
+
+/* hist_kernel_select picks the best versions for this CPU, before main(). */
+__attribute__((constructor)) static void hist_kernel_select(void) {
+  if (0 == hist_kernel_use(HIST_KERNEL_AVX2))
+    return;
+  if (0 == hist_kernel_use(HIST_KERNEL_SSE2))
+    return;
+  hist_kernel_use(HIST_KERNEL_SCALAR);
+}
+
+void hist_kernel_sub_u16(int32_t *dst, const uint16_t *src, int n) {
+  hist_kernel.sub_u16(dst, src, n);
+}
+
+float hist_kernel_scale_add(float *dst, float scale, const int32_t *src,
+                            int n) {
+  return hist_kernel.scale_add(dst, scale, src, n);
+}
+
+int hist_kernel_percentile(const int32_t *hist, int64_t total, double q,
+                           int n) {
+  double target = q * total;
+  int64_t sum = 0;
+
+  for (int i = 0; i < n; i++) {
+    sum += hist[i];
+    if (sum >= target)
+      return i;
+  }
+  return n - 1;
+}
+
+double hist_kernel_distance(const int32_t *a, double a_total, const float *b,
+                            double b_total, int n) {
+  double cdf_a = 0;
+  double cdf_b = 0;
+  double dist = 0;
+
+  if (a_total <= 0 || b_total <= 0)
+    return 0;
+
+  for (int i = 0; i < n; i++) {
+    cdf_a += a[i] / a_total;
+    cdf_b += b[i] / b_total;
+    dist += cdf_a > cdf_b ? cdf_a - cdf_b : cdf_b - cdf_a;
+  }
+  return dist;
+}
@@ -0,0 +1,50 @@
+#ifndef QUA_HIST_KERNEL_H
+#define QUA_HIST_KERNEL_H
+
+#include <stdint.h>
+
+/*
+ * Kernels for dense arrays of bucket counts (num_buckets long), shared by
+ * the daemon and the tools. On x86, AVX2 or SSE2 versions are picked at
+ * startup, depending on the CPU; elsewhere, plain loops are used.
+ */
+
+enum hist_kernel_isa {
+  HIST_KERNEL_SCALAR,
+  HIST_KERNEL_SSE2,
+  HIST_KERNEL_AVX2,
+};
+
+/*
+ * hist_kernel_use switches the element-wise kernels to the versions for isa
+ * (e.g. to test or benchmark each of them). Returns 0 on success, -1 if
+ * this CPU or build does not have them.
+ */
+int hist_kernel_use(enum hist_kernel_isa isa);
+
+/* hist_kernel_sub_u16 subtracts src from dst, element-wise. */
+void hist_kernel_sub_u16(int32_t *dst, const uint16_t *src, int n);
+
+/*
+ * hist_kernel_scale_add computes dst = dst * scale + src, element-wise.
+ * Returns the sum of dst afterwards.
+ */
+float hist_kernel_scale_add(float *dst, float scale, const int32_t *src,
+                            int n);
+
+/*
+ * hist_kernel_percentile returns the first index at which the cumulative
+ * count of hist reaches q (0..1) of total, or n - 1 if it never does.
+ */
+int hist_kernel_percentile(const int32_t *hist, int64_t total, double q,
+                           int n);
+
+/*
+ * hist_kernel_distance returns the L1 distance between the CDFs of a and b,
+ * normalized by their totals, in buckets. For 1-d distributions, that is
+ * the earth mover's distance. Returns 0 if either total is 0.
+ */
+double hist_kernel_distance(const int32_t *a, double a_total, const float *b,
+                            double b_total, int n);
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ * qt-hist-kernel-bench times each kernel on arrays of num_buckets elements,
+ * once per version (scalar, SSE2, AVX2, as far as the CPU has them).
+ *
+ * Usage: qt-hist-kernel-bench [-n iterations]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "hist_kernel.h"
+#include "histogram.h"
+#include "test_util.h"
+
+static const char *isa_name[] = {
+    [HIST_KERNEL_SCALAR] = "scalar",
+    [HIST_KERNEL_SSE2] = "sse2",
+    [HIST_KERNEL_AVX2] = "avx2",
+};
+
+static int32_t dst_i32[num_buckets];
+static uint16_t src_u16[num_buckets];
+static float dst_f[num_buckets];
+static int32_t src_i32[num_buckets];
+
+/* sink keeps results alive, so that no call is optimized out */
+static volatile double sink;
+
+static void report(const char *isa, const char *kernel, int64_t ns,
+                   long iterations, double scalar_ns) {
+  double per_call = (double)ns / iterations;
+
+  if (scalar_ns > 0)
+    printf("%-7s %-11s %8.1f ns/call  %5.2fx\n", isa, kernel, per_call,
+           scalar_ns / per_call);
+  else
+    printf("%-7s %-11s %8.1f ns/call\n", isa, kernel, per_call);
+}
+
+int main(int argc, char **argv) {
+  long iterations = 1000000;
+  double scalar_ns[2] = {0};
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:h")) != -1) {
+    switch (opt) {
+    case 'n':
+      iterations = atol(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (iterations < 1) {
+    fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+    return 1;
+  }
+
+  srand(1);
+  for (int i = 0; i < num_buckets; i++) {
+    src_u16[i] = rand() % 4;
+    src_i32[i] = rand() % 100;
+    dst_f[i] = rand() % 100;
+  }
+
+  printf("%d buckets, %ld iterations\n", num_buckets, iterations);
+
+  for (int isa = HIST_KERNEL_SCALAR; isa <= HIST_KERNEL_AVX2; isa++) {
+    if (0 != hist_kernel_use(isa)) {
+      printf("%-7s not supported, skipped\n", isa_name[isa]);
+      continue;
+    }
+
+    int64_t start = now_ns();
+    for (long i = 0; i < iterations; i++)
+      hist_kernel_sub_u16(dst_i32, src_u16, num_buckets);
+    int64_t ns = now_ns() - start;
+    sink = dst_i32[num_buckets - 1];
+    report(isa_name[isa], "sub_u16", ns, iterations, scalar_ns[0]);
+    if (isa == HIST_KERNEL_SCALAR)
+      scalar_ns[0] = (double)ns / iterations;
+
+    /* Scale < 1 keeps dst bounded, as in the baseline's decay */
+    double sum = 0;
+    start = now_ns();
+    for (long i = 0; i < iterations; i++)
+      sum += hist_kernel_scale_add(dst_f, 0.75f, src_i32, num_buckets);
+    ns = now_ns() - start;
+    sink = sum;
+    report(isa_name[isa], "scale_add", ns, iterations, scalar_ns[1]);
+    if (isa == HIST_KERNEL_SCALAR)
+      scalar_ns[1] = (double)ns / iterations;
+  }
+
+  /* Plain loops everywhere, so timed once */
+  int64_t start = now_ns();
+  int64_t idx = 0;
+  for (long i = 0; i < iterations; i++)
+    idx += hist_kernel_percentile(src_i32, 100 * num_buckets / 2,
+                                  (double)(i % 100) / 100, num_buckets);
+  sink = idx;
+  report("scalar", "percentile", now_ns() - start, iterations, 0);
+
+  start = now_ns();
+  double dist = 0;
+  for (long i = 0; i < iterations; i++)
+    dist += hist_kernel_distance(src_i32, 100 * num_buckets / 2, dst_f,
+                                 100 * num_buckets / 2, num_buckets);
+  sink = dist;
+  report("scalar", "distance", now_ns() - start, iterations, 0);
+
+  return 0;
+}
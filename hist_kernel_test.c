@@ -0,0 +1,189 @@
+/*
+ * qt-hist-kernel-test checks every version of the element-wise kernels
+ * (scalar, SSE2, AVX2, as far as the CPU has them) against plain loops, on
+ * random data, for lengths around the vector widths and the bucket count.
+ * Percentile and distance are checked on small inputs with known answers.
+ *
+ * Exits with 0 if all checks pass, 1 otherwise.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hist_kernel.h"
+#include "histogram.h"
+
+/* Longest array tested; leaves room past the end to catch overruns */
+enum { max_len = 1024, guard = 16 };
+
+static const char *isa_name[] = {
+    [HIST_KERNEL_SCALAR] = "scalar",
+    [HIST_KERNEL_SSE2] = "sse2",
+    [HIST_KERNEL_AVX2] = "avx2",
+};
+
+static int num_failed;
+
+/* rand64 returns 64 random bits (rand() only has 31). */
+static uint64_t rand64(void) {
+  return (uint64_t)rand() << 62 ^ (uint64_t)rand() << 31 ^ rand();
+}
+
+static void fail(enum hist_kernel_isa isa, const char *kernel, int n, int i) {
+  fprintf(stderr, "FAIL: %s %s, n=%d: mismatch at %d\n", isa_name[isa],
+          kernel, n, i);
+  num_failed++;
+}
+
+static void test_sub_u16(enum hist_kernel_isa isa, int n) {
+  static int32_t dst[max_len + guard];
+  static int32_t want[max_len + guard];
+  static uint16_t src[max_len + guard];
+
+  for (int i = 0; i < n + guard; i++) {
+    /* Either sign: the kernel must not assume dst >= src */
+    dst[i] = rand() % (1 << 30) - (1 << 29);
+    src[i] = rand64();
+    want[i] = dst[i];
+  }
+  for (int i = 0; i < n; i++)
+    want[i] -= src[i];
+
+  hist_kernel_sub_u16(dst, src, n);
+
+  for (int i = 0; i < n + guard; i++) {
+    if (dst[i] != want[i]) {
+      fail(isa, "sub_u16", n, i);
+      return;
+    }
+  }
+}
+
+static void test_scale_add(enum hist_kernel_isa isa, int n) {
+  static float dst[max_len + guard];
+  static float want[max_len + guard];
+  static int32_t src[max_len + guard];
+  float scale = (float)(rand() % 1000) / 1000;
+  double want_sum = 0;
+
+  for (int i = 0; i < n + guard; i++) {
+    dst[i] = (float)(rand() % 100000) / 7;
+    src[i] = rand() % 65536;
+    want[i] = dst[i];
+  }
+  for (int i = 0; i < n; i++) {
+    want[i] = want[i] * scale + (float)src[i];
+    want_sum += want[i];
+  }
+
+  float sum = hist_kernel_scale_add(dst, scale, src, n);
+
+  /* Element-wise results are exact; the sum is added up in another order */
+  for (int i = 0; i < n + guard; i++) {
+    if (dst[i] != want[i]) {
+      fail(isa, "scale_add", n, i);
+      return;
+    }
+  }
+  if (fabs(sum - want_sum) > 1e-5 * fabs(want_sum) + 1e-3) {
+    fprintf(stderr, "FAIL: %s scale_add, n=%d: sum %g, want %g\n",
+            isa_name[isa], n, sum, want_sum);
+    num_failed++;
+  }
+}
+
+/* Percentile and distance are plain loops, so checked on known answers */
+
+static void check_percentile(const int32_t *hist, int64_t total, double q,
+                             int n, int want) {
+  int got = hist_kernel_percentile(hist, total, q, n);
+  if (got != want) {
+    fprintf(stderr, "FAIL: percentile q=%g of %" PRId64 ": %d, want %d\n", q,
+            total, got, want);
+    num_failed++;
+  }
+}
+
+static void check_distance(const int32_t *a, double a_total, const float *b,
+                           double b_total, int n, double want) {
+  double got = hist_kernel_distance(a, a_total, b, b_total, n);
+  if (fabs(got - want) > 1e-9) {
+    fprintf(stderr, "FAIL: distance: %g, want %g\n", got, want);
+    num_failed++;
+  }
+}
+
+static void test_percentile(void) {
+  static const int32_t hist[] = {0, 2, 0, 2, 0, 0};
+  static const int32_t empty[6];
+  int n = sizeof(hist) / sizeof(hist[0]);
+
+  check_percentile(hist, 4, 0, n, 0);
+  check_percentile(hist, 4, 0.25, n, 1);
+  check_percentile(hist, 4, 0.5, n, 1);
+  check_percentile(hist, 4, 0.75, n, 3);
+  /* The first bucket reaching the total, not the last one */
+  check_percentile(hist, 4, 1, n, 3);
+  /* A total the counts never reach */
+  check_percentile(hist, 5, 1, n, n - 1);
+  check_percentile(empty, 0, 0.5, n, 0);
+}
+
+static void test_distance(void) {
+  static const int32_t first[] = {1, 0, 0, 0};
+  static const float first_f[] = {1, 0, 0, 0};
+  static const float last[] = {0, 0, 0, 1};
+  static const int32_t half[] = {2, 0, 0, 2};
+  static const float half_scaled[] = {0.5f, 0, 0, 0.5f};
+  static const int32_t empty_a[4];
+  static const float empty_b[4];
+
+  /* All mass moves 3 buckets */
+  check_distance(first, 1, last, 1, 4, 3);
+  check_distance(first, 1, first_f, 1, 4, 0);
+  /* Half the mass moves 3 buckets; totals normalize */
+  check_distance(half, 4, last, 1, 4, 1.5);
+  check_distance(half, 4, half_scaled, 1, 4, 0);
+  check_distance(empty_a, 0, last, 1, 4, 0);
+  check_distance(first, 1, empty_b, 0, 4, 0);
+}
+
+int main(void) {
+  /* Around the vector widths (2, 4, 8 and 16 elements), and bucket counts */
+  static const int lens[] = {
+      0,  1,  2,  3,  4,  5,  7,  8,  9,  15,
+      16, 17, 31, 32, 33, num_buckets - 1, num_buckets, num_buckets + 1,
+      max_len - 1, max_len,
+  };
+  int num_lens = sizeof(lens) / sizeof(lens[0]);
+
+  srand(1);
+
+  for (int isa = HIST_KERNEL_SCALAR; isa <= HIST_KERNEL_AVX2; isa++) {
+    if (0 != hist_kernel_use(isa)) {
+      printf("%s: not supported, skipped\n", isa_name[isa]);
+      continue;
+    }
+
+    int failed_before = num_failed;
+    for (int rep = 0; rep < 100; rep++) {
+      for (int l = 0; l < num_lens; l++) {
+        test_sub_u16(isa, lens[l]);
+        test_scale_add(isa, lens[l]);
+      }
+    }
+    printf("%s: %s\n", isa_name[isa],
+           num_failed == failed_before ? "ok" : "FAIL");
+  }
+
+  int failed_before = num_failed;
+  test_percentile();
+  test_distance();
+  printf("percentile, distance: %s\n",
+         num_failed == failed_before ? "ok" : "FAIL");
+
+  return num_failed ? 1 : 0;
+}
@@ -0,0 +1,72 @@
+#include <stdio.h>
+
+#include "hist_kernel.h"
+
+#include "histogram.h"
+
+int histogram_index_to_bucket_name(int idx, char *out, size_t out_len) {
+  if (idx >= num_regular_buckets)
+    return snprintf(out, out_len, "inf");
+  return snprintf(out, out_len, "%d", bucket_width_ms * idx);
+}
+
+void histogram_add_msec(struct histogram *h, int msec) {
+  histogram_add(h, histogram_index_from_msec(msec), 1);
+}
+
+void histogram_add(struct histogram *h, int idx, int n) {
+  h->bucket[idx] += n;
+  h->touched[idx / 64] |= UINT64_C(1) << (idx % 64);
+  h->num_keys += n;
+}
+
+void histogram_sub(struct histogram *h, int idx, int n) {
+  h->bucket[idx] -= n;
+  if (h->bucket[idx] == 0)
+    h->touched[idx / 64] &= ~(UINT64_C(1) << (idx % 64));
+  h->num_keys -= n;
+}
+
+void histogram_sub_dense(struct histogram *h, const uint16_t *src,
+                         int nkeys) {
+  hist_kernel_sub_u16(h->bucket, src, num_buckets);
+  h->num_keys -= nkeys;
+
+  /* Only touched buckets can have become zero. */
+  for (int w = 0; w < num_touched_words; w++) {
+    uint64_t word = h->touched[w];
+    while (word) {
+      int idx = w * 64 + __builtin_ctzll(word);
+      if (h->bucket[idx] == 0)
+        h->touched[w] &= ~(UINT64_C(1) << (idx % 64));
+      word &= word - 1;
+    }
+  }
+}
+
+int histogram_next(const struct histogram *h, int idx) {
+  if (idx < 0)
+    idx = 0;
+
+  for (int w = idx / 64; w < num_touched_words; w++) {
+    uint64_t word = h->touched[w];
+    if (w == idx / 64)
+      word &= ~UINT64_C(0) << (idx % 64);
+    if (word)
+      return w * 64 + __builtin_ctzll(word);
+  }
+
+  return -1;
+}
+
+void histogram_reset(struct histogram *h) {
+  for (int w = 0; w < num_touched_words; w++) {
+    uint64_t word = h->touched[w];
+    while (word) {
+      h->bucket[w * 64 + __builtin_ctzll(word)] = 0;
+      word &= word - 1;
+    }
+    h->touched[w] = 0;
+  }
+  h->num_keys = 0;
+}
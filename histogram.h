@@ -0,0 +1,63 @@
+#ifndef QUA_HISTOGRAM_H
+#define QUA_HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+  max_bucket_ms = 2000,
+  bucket_width_ms = 10,
+  num_regular_buckets = max_bucket_ms / bucket_width_ms,
+  num_buckets = num_regular_buckets + 1, /* overflow bucket */
+  num_touched_words = (num_buckets + 63) / 64,
+};
+
+/*
+ * histogram is a distribution of delays between keypresses.
+ * It remembers which buckets are nonzero, so that iterating and resetting
+ * costs O(touched buckets) instead of O(num_buckets).
+ */
+struct histogram {
+  int bucket[num_buckets];
+
+  /* touched has one bit per bucket, set iff the bucket is nonzero. */
+  uint64_t touched[num_touched_words];
+
+  /* num_keys is the total number of keys across all buckets. */
+  int num_keys;
+};
+
+/* Inline, so that libqtjournal needs nothing else of histogram.c */
+static inline int histogram_index_from_msec(int msec) {
+  if (msec < 0)
+    return 0;
+  if (msec > max_bucket_ms)
+    return num_regular_buckets; /* overflow bucket */
+  return msec / bucket_width_ms;
+}
+
+int histogram_index_to_bucket_name(int idx, char *out, size_t out_len);
+
+void histogram_add_msec(struct histogram *h, int msec);
+
+/* histogram_add adds n keys to bucket idx. */
+void histogram_add(struct histogram *h, int idx, int n);
+
+/* histogram_sub removes n keys from bucket idx, which must hold at least n. */
+void histogram_sub(struct histogram *h, int idx, int n);
+
+/*
+ * histogram_sub_dense subtracts the dense distribution src, holding nkeys
+ * keys, bucket by bucket. Every bucket must hold at least as many keys as
+ * in src.
+ */
+void histogram_sub_dense(struct histogram *h, const uint16_t *src,
+                         int nkeys);
+
+/* histogram_next returns the first nonzero bucket index >= idx, or -1. */
+int histogram_next(const struct histogram *h, int idx);
+
+/* histogram_reset zeroes all touched buckets. */
+void histogram_reset(struct histogram *h);
+
+#endif
@@ -5,7 +5,7 @@
 #include <regex.h>
 #include <stdbool.h>
 #include <stdio.h>
-#include <stdlib.h> // IWYU pragma: keep - required for abort
+#include <stdlib.h>
 #include <sys/inotify.h>
 #include <unistd.h>
 
@@ -13,7 +13,8 @@
 
 #include "inotify_thread.h"
 
-static const char * const dev_input_path = "/dev/input";
+/* May be overwritten via $INPUT_DIRECTORY environment variable (for testing). */
+static const char *dev_input_path = "/dev/input";
 
 static int is_event_filename(char *name)
 {
@@ -67,8 +68,8 @@ out_1:
 
 static void handle_inotify_event(struct inotify_event *i)
 {
-	if (!(i->mask & IN_CREATE)) {
-		return; /* Not a create event */
+	if (!(i->mask & (IN_CREATE | IN_MOVED_TO))) {
+		return; /* Not a create (or move into directory) event */
 	}
 
 	if (i->len <= 0) {
@@ -92,7 +93,7 @@ static void *inotify_thread(void *arg)
 		goto err_1;
 	}
 
-	if (inotify_add_watch(inotify_fd, dev_input_path, IN_CREATE) < 0) {
+	if (inotify_add_watch(inotify_fd, dev_input_path, IN_CREATE | IN_MOVED_TO) < 0) {
 		fprintf(stderr, "error: failed to add inotify watch for %s: %m\n", dev_input_path);
 		goto err_2;
 	}
@@ -143,6 +144,11 @@ int spawn_inotify_thread(void)
 {
 	int ret = 1; /* Error */
 
+	char *dir = getenv("INPUT_DIRECTORY");
+	if (dir && *dir) {
+		dev_input_path = dir;
+	}
+
 	/* Initialize the pthread attribute object */
 	pthread_attr_t pthread_attr;
 	errno = pthread_attr_init(&pthread_attr);
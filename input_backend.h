@@ -0,0 +1,40 @@
+#ifndef QUA_INPUT_BACKEND_H
+#define QUA_INPUT_BACKEND_H
+
+#include <stdbool.h>
+
+#include <linux/input.h>
+
+/*
+ * input_backend talks to an evdev device node, for input_device.
+ * There are two implementations, chosen at build time (WITH_LIBEVDEV):
+ * input_backend_libevdev.c, and input_backend_ioctl.c, which uses the
+ * kernel's ioctls directly.
+ */
+struct input_backend;
+
+/*
+ * input_backend_open sets up the evdev device open at fd. It does not take
+ * ownership of fd. Returns 0 on success, 1 on error.
+ */
+int input_backend_open(int fd, struct input_backend **out);
+
+void input_backend_free(struct input_backend *backend);
+
+bool input_backend_has_keys(struct input_backend *backend);
+
+const char *input_backend_get_name(struct input_backend *backend);
+
+/* input_backend_get_phys returns the physical location, or NULL if unknown. */
+const char *input_backend_get_phys(struct input_backend *backend);
+
+/* Returns 0 on success, 1 if unsupported. */
+int input_backend_set_clock_monotonic(struct input_backend *backend);
+
+/*
+ * input_backend_next_event waits for the next event.
+ * Returns 0 on success, 1 if the device is gone (or on error).
+ */
+int input_backend_next_event(struct input_backend *backend, struct input_event *event);
+
+#endif
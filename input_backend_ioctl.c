@@ -0,0 +1,150 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/input.h>
+
+#include "input_backend.h"
+
+/*
+ * Reads events with plain read()s, and asks the kernel only for what the
+ * daemon needs: whether there are keys, the name and the phys path. Unlike
+ * libevdev, it keeps no copy of the device's state.
+ */
+
+/* Events are read in batches of this many */
+enum { event_buf_len = 64 };
+
+struct input_backend {
+	int fd;
+
+	bool has_keys;
+	bool has_phys;
+	char name[256];
+	char phys[256];
+
+	/* Events read, but not returned yet: event[pos] .. event[len - 1] */
+	struct input_event event[event_buf_len];
+	int pos;
+	int len;
+
+	/* Events were dropped; skip everything up to the next SYN_REPORT. */
+	bool dropped;
+};
+
+int input_backend_open(int fd, struct input_backend **out)
+{
+	unsigned long ev_bits = 0;
+	int version;
+
+	/* Fails for anything that's not an evdev node */
+	if (ioctl(fd, EVIOCGVERSION, &version) < 0) {
+		fprintf(stderr, "error: failed to get evdev version: %m\n");
+		goto err_1;
+	}
+
+	struct input_backend *backend = calloc(sizeof(*backend), 1);
+	if (!backend) {
+		fprintf(stderr, "error: %m\n");
+		goto err_1;
+	}
+	backend->fd = fd;
+
+	if (ioctl(fd, EVIOCGBIT(0, sizeof(ev_bits)), &ev_bits) < 0) {
+		fprintf(stderr, "error: failed to get event types: %m\n");
+		goto err_2;
+	}
+	backend->has_keys = ev_bits & (1UL << EV_KEY);
+
+	/* Both are optional, and not necessarily NUL terminated */
+	if (ioctl(fd, EVIOCGNAME(sizeof(backend->name) - 1), backend->name) < 0) {
+		backend->name[0] = '\0';
+	}
+	backend->has_phys = ioctl(fd, EVIOCGPHYS(sizeof(backend->phys) - 1), backend->phys) >= 0;
+
+	*out = backend;
+	return 0; /* Success */
+
+err_2:
+	free(backend);
+err_1:
+	return 1; /* Error */
+}
+
+void input_backend_free(struct input_backend *backend)
+{
+	free(backend);
+}
+
+bool input_backend_has_keys(struct input_backend *backend)
+{
+	return backend->has_keys;
+}
+
+const char *input_backend_get_name(struct input_backend *backend)
+{
+	return backend->name;
+}
+
+const char *input_backend_get_phys(struct input_backend *backend)
+{
+	return backend->has_phys ? backend->phys : NULL;
+}
+
+int input_backend_set_clock_monotonic(struct input_backend *backend)
+{
+	int clock_id = CLOCK_MONOTONIC;
+
+	return 0 == ioctl(backend->fd, EVIOCSCLOCKID, &clock_id) ? 0 : 1;
+}
+
+/* Refills the event buffer. Returns 0 on success, 1 if the device is gone. */
+static int read_events(struct input_backend *backend)
+{
+	ssize_t rc;
+
+	do {
+		rc = read(backend->fd, backend->event, sizeof(backend->event));
+	} while (rc < 0 && (errno == EINTR || errno == EAGAIN));
+
+	/* The kernel only returns whole events */
+	if (rc <= 0 || rc % sizeof(struct input_event) != 0) {
+		return 1; /* Device gone (ENODEV), or error */
+	}
+
+	backend->pos = 0;
+	backend->len = rc / sizeof(struct input_event);
+	return 0;
+}
+
+int input_backend_next_event(struct input_backend *backend, struct input_event *event)
+{
+	while (true) {
+		if (backend->pos == backend->len && 0 != read_events(backend)) {
+			return 1;
+		}
+
+		*event = backend->event[backend->pos++];
+
+		/*
+		 * The kernel's buffer overflowed. As documented for evdev, the
+		 * events up to the next SYN_REPORT are incomplete. Key downs
+		 * that were lost stay lost; the daemon doesn't track key state.
+		 */
+		if (event->type == EV_SYN && event->code == SYN_DROPPED) {
+			backend->dropped = true;
+			continue;
+		}
+		if (backend->dropped) {
+			if (event->type == EV_SYN && event->code == SYN_REPORT) {
+				backend->dropped = false;
+			}
+			continue;
+		}
+
+		return 0;
+	}
+}
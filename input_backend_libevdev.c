@@ -0,0 +1,81 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <libevdev/libevdev.h>
+
+#include "input_backend.h"
+
+struct input_backend {
+	struct libevdev *dev;
+};
+
+int input_backend_open(int fd, struct input_backend **out)
+{
+	struct input_backend *backend = calloc(sizeof(*backend), 1);
+	if (!backend) {
+		fprintf(stderr, "error: %m\n");
+		goto err_1;
+	}
+
+	if (libevdev_new_from_fd(fd, &backend->dev) < 0) {
+		fprintf(stderr, "error: failed to init libevdev dev: %m\n");
+		goto err_2;
+	}
+
+	*out = backend;
+	return 0; /* Success */
+
+err_2:
+	free(backend);
+err_1:
+	return 1; /* Error */
+}
+
+void input_backend_free(struct input_backend *backend)
+{
+	/* libevdev doesn't manage fd's, it only uses them. */
+	libevdev_free(backend->dev);
+	free(backend);
+}
+
+bool input_backend_has_keys(struct input_backend *backend)
+{
+	return libevdev_has_event_type(backend->dev, EV_KEY);
+}
+
+const char *input_backend_get_name(struct input_backend *backend)
+{
+	return libevdev_get_name(backend->dev);
+}
+
+const char *input_backend_get_phys(struct input_backend *backend)
+{
+	return libevdev_get_phys(backend->dev);
+}
+
+int input_backend_set_clock_monotonic(struct input_backend *backend)
+{
+	return 0 == libevdev_set_clock_id(backend->dev, CLOCK_MONOTONIC) ? 0 : 1;
+}
+
+int input_backend_next_event(struct input_backend *backend, struct input_event *event)
+{
+	int rc;
+
+	do {
+		rc = libevdev_next_event(
+				backend->dev,
+				LIBEVDEV_READ_FLAG_NORMAL | LIBEVDEV_READ_FLAG_BLOCKING,
+				event);
+
+		if (rc == LIBEVDEV_READ_STATUS_SUCCESS) {
+			return 0;
+		}
+
+	} while (rc == LIBEVDEV_READ_STATUS_SYNC
+			|| rc == -EAGAIN);
+
+	return 1; /* Device gone, or error */
+}
@@ -0,0 +1,157 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <linux/input.h>
+
+#include "input_backend.h"
+
+#include "input_device.h"
+
+struct input_device {
+	int fd;
+
+	/* Device number, 0 for fake (FIFO) devices */
+	dev_t devnum;
+
+	/* NULL for fake (FIFO) devices */
+	struct input_backend *backend;
+};
+
+int input_device_open(const char *path, struct input_device **out)
+{
+	struct stat st;
+
+	/*
+	 * Don't block on FIFOs without writers. Fake devices are moved into
+	 * place with their writer already attached.
+	 */
+	int fd = open(path, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		fprintf(stderr, "error: failed to open %s: %m\n", path);
+		goto err_1;
+	}
+
+	/* Reads below are blocking. */
+	if (0 != fcntl(fd, F_SETFL, 0)) {
+		fprintf(stderr, "error: failed to set flags of %s: %m\n", path);
+		goto err_2;
+	}
+
+	if (0 != fstat(fd, &st)) {
+		fprintf(stderr, "error: failed to stat %s: %m\n", path);
+		goto err_2;
+	}
+
+	struct input_device *dev = calloc(sizeof(*dev), 1);
+	if (!dev) {
+		fprintf(stderr, "error: %m\n");
+		goto err_2;
+	}
+	dev->fd = fd;
+	if (S_ISCHR(st.st_mode)) {
+		dev->devnum = st.st_rdev;
+	}
+
+	if (!S_ISFIFO(st.st_mode) && 0 != input_backend_open(fd, &dev->backend)) {
+		goto err_3;
+	}
+
+	*out = dev;
+	return 0; /* Success */
+
+err_3:
+	free(dev);
+err_2:
+	close(fd);
+err_1:
+	return 1; /* Error */
+}
+
+void input_device_free(struct input_device *dev)
+{
+	if (!dev) {
+		return;
+	}
+
+	/* The backend doesn't manage fd's, it only uses them. */
+	if (dev->backend) {
+		input_backend_free(dev->backend);
+	}
+	close(dev->fd);
+	free(dev);
+}
+
+bool input_device_has_keys(struct input_device *dev)
+{
+	if (!dev->backend) {
+		return true;
+	}
+
+	return input_backend_has_keys(dev->backend);
+}
+
+const char *input_device_get_name(struct input_device *dev)
+{
+	if (!dev->backend) {
+		return "fifo";
+	}
+
+	return input_backend_get_name(dev->backend);
+}
+
+const char *input_device_get_phys(struct input_device *dev)
+{
+	if (!dev->backend) {
+		return NULL;
+	}
+
+	return input_backend_get_phys(dev->backend);
+}
+
+dev_t input_device_get_devnum(struct input_device *dev)
+{
+	return dev->devnum;
+}
+
+int input_device_set_clock_monotonic(struct input_device *dev)
+{
+	if (!dev->backend) {
+		return 1; /* Fake devices have arbitrary timestamps */
+	}
+
+	return input_backend_set_clock_monotonic(dev->backend);
+}
+
+/* Reads one whole struct input_event from a FIFO. */
+static int fifo_next_event(struct input_device *dev, struct input_event *event)
+{
+	char *buf = (char *)event;
+	size_t len = 0;
+
+	while (len < sizeof(*event)) {
+		ssize_t rc = read(dev->fd, buf + len, sizeof(*event) - len);
+		if (rc < 0 && errno == EINTR) {
+			continue;
+		}
+		if (rc <= 0) {
+			return 1; /* EOF (all writers gone) or error */
+		}
+		len += rc;
+	}
+
+	return 0;
+}
+
+int input_device_next_event(struct input_device *dev, struct input_event *event)
+{
+	if (!dev->backend) {
+		return fifo_next_event(dev, event);
+	}
+
+	return input_backend_next_event(dev->backend, event);
+}
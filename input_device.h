@@ -0,0 +1,47 @@
+#ifndef QUA_INPUT_DEVICE_H
+#define QUA_INPUT_DEVICE_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include <linux/input.h>
+
+/*
+ * input_device reads input events from an evdev device node.
+ *
+ * For testing, it also accepts a FIFO instead, which carries plain
+ * struct input_event records. Such a fake device has keys, its name is
+ * "fifo", and it is gone once all writers have closed it.
+ */
+struct input_device;
+
+/* input_device_open opens path. Returns 0 on success, 1 on error. */
+int input_device_open(const char *path, struct input_device **out);
+
+/* input_device_free closes the device. Accepts NULL. */
+void input_device_free(struct input_device *dev);
+
+/* input_device_has_keys returns whether the device can send EV_KEY events. */
+bool input_device_has_keys(struct input_device *dev);
+
+const char *input_device_get_name(struct input_device *dev);
+
+/* input_device_get_phys returns the physical location, or NULL if unknown. */
+const char *input_device_get_phys(struct input_device *dev);
+
+/* input_device_get_devnum returns the device number, or 0 if none. */
+dev_t input_device_get_devnum(struct input_device *dev);
+
+/*
+ * input_device_set_clock_monotonic makes event timestamps CLOCK_MONOTONIC.
+ * Returns 0 on success, 1 if unsupported.
+ */
+int input_device_set_clock_monotonic(struct input_device *dev);
+
+/*
+ * input_device_next_event waits for the next event.
+ * Returns 0 on success, 1 if the device is gone (or on error).
+ */
+int input_device_next_event(struct input_device *dev, struct input_event *event);
+
+#endif
@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "probes.h"
+
 #include "journal.h"
 
 static FILE *journal_stream;
@@ -38,9 +40,11 @@ journal_add(const char *format, ...) {
   va_list args;
   va_start(args, format);
 
-  vfprintf(journal_stream, format, args);
+  int len = vfprintf(journal_stream, format, args);
   fflush(journal_stream);
 
+  QUA_PROBE1(journal_add, len);
+
   va_end(args);
 }
 
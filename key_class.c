@@ -0,0 +1,56 @@
+#include "key_class.h"
+
+/* Unlisted codes are 0, i.e. KEY_CLASS_OTHER. */
+const unsigned char key_class_table[KEY_CNT] = {
+    [KEY_1 ... KEY_EQUAL] = KEY_CLASS_ALNUM,
+    [KEY_Q ... KEY_RIGHTBRACE] = KEY_CLASS_ALNUM,
+    [KEY_A ... KEY_GRAVE] = KEY_CLASS_ALNUM,
+    [KEY_BACKSLASH ... KEY_SLASH] = KEY_CLASS_ALNUM,
+    [KEY_KPASTERISK] = KEY_CLASS_ALNUM,
+    [KEY_KP7 ... KEY_KPDOT] = KEY_CLASS_ALNUM,
+    [KEY_102ND] = KEY_CLASS_ALNUM,
+    [KEY_KPSLASH] = KEY_CLASS_ALNUM,
+    [KEY_KPEQUAL] = KEY_CLASS_ALNUM,
+    [KEY_KPCOMMA] = KEY_CLASS_ALNUM,
+
+    [KEY_SPACE] = KEY_CLASS_SPACE,
+    [KEY_TAB] = KEY_CLASS_SPACE,
+    [KEY_ENTER] = KEY_CLASS_SPACE,
+    [KEY_KPENTER] = KEY_CLASS_SPACE,
+
+    [KEY_BACKSPACE] = KEY_CLASS_CORRECTION,
+    [KEY_DELETE] = KEY_CLASS_CORRECTION,
+
+    [KEY_LEFTCTRL] = KEY_CLASS_MODIFIER,
+    [KEY_RIGHTCTRL] = KEY_CLASS_MODIFIER,
+    [KEY_LEFTSHIFT] = KEY_CLASS_MODIFIER,
+    [KEY_RIGHTSHIFT] = KEY_CLASS_MODIFIER,
+    [KEY_LEFTALT] = KEY_CLASS_MODIFIER,
+    [KEY_RIGHTALT] = KEY_CLASS_MODIFIER,
+    [KEY_LEFTMETA] = KEY_CLASS_MODIFIER,
+    [KEY_RIGHTMETA] = KEY_CLASS_MODIFIER,
+    [KEY_CAPSLOCK] = KEY_CLASS_MODIFIER,
+
+    [KEY_UP] = KEY_CLASS_NAVIGATION,
+    [KEY_DOWN] = KEY_CLASS_NAVIGATION,
+    [KEY_LEFT] = KEY_CLASS_NAVIGATION,
+    [KEY_RIGHT] = KEY_CLASS_NAVIGATION,
+    [KEY_HOME] = KEY_CLASS_NAVIGATION,
+    [KEY_END] = KEY_CLASS_NAVIGATION,
+    [KEY_PAGEUP] = KEY_CLASS_NAVIGATION,
+    [KEY_PAGEDOWN] = KEY_CLASS_NAVIGATION,
+    [KEY_INSERT] = KEY_CLASS_NAVIGATION,
+};
+
+static const char *const key_class_names[NUM_KEY_CLASSES] = {
+    [KEY_CLASS_OTHER] = "other",
+    [KEY_CLASS_ALNUM] = "alnum",
+    [KEY_CLASS_SPACE] = "space",
+    [KEY_CLASS_CORRECTION] = "correction",
+    [KEY_CLASS_MODIFIER] = "modifier",
+    [KEY_CLASS_NAVIGATION] = "navigation",
+};
+
+const char *key_class_name(enum key_class key_class) {
+  return key_class_names[key_class];
+}
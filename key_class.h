@@ -0,0 +1,27 @@
+#ifndef QUA_KEY_CLASS_H
+#define QUA_KEY_CLASS_H
+
+#include <linux/input-event-codes.h>
+
+/* key_class is what kind of key was pressed. Individual keys are not kept. */
+enum key_class {
+  KEY_CLASS_OTHER = 0,  /* function keys, mouse buttons, ... */
+  KEY_CLASS_ALNUM,      /* letters, digits and punctuation */
+  KEY_CLASS_SPACE,      /* space, tab, enter */
+  KEY_CLASS_CORRECTION, /* backspace, delete */
+  KEY_CLASS_MODIFIER,   /* shift, ctrl, alt, meta, caps lock */
+  KEY_CLASS_NAVIGATION, /* arrows, home/end, page up/down, insert */
+  NUM_KEY_CLASSES,
+};
+
+extern const unsigned char key_class_table[KEY_CNT];
+
+/* key_class_name returns a short name for JSON output. */
+const char *key_class_name(enum key_class key_class);
+
+static inline enum key_class key_class_of(unsigned int code) {
+  /* EV_KEY codes never exceed KEY_MAX */
+  return code < KEY_CNT ? key_class_table[code] : KEY_CLASS_OTHER;
+}
+
+#endif
@@ -0,0 +1,71 @@
+#include <stdbool.h>
+
+#include "key_merge.h"
+
+/* More keys than this within one reorder window is not typing anyway. */
+enum { key_merge_capacity = 1024 };
+
+/* Binary min-heap by press time */
+static struct {
+  struct key_press heap[key_merge_capacity];
+  int len;
+} key_merge_data;
+
+static void swap(struct key_press *a, struct key_press *b) {
+  struct key_press tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+static void sift_up(int i) {
+  struct key_press *heap = key_merge_data.heap;
+  while (i > 0 && heap[(i - 1) / 2].ns > heap[i].ns) {
+    swap(&heap[(i - 1) / 2], &heap[i]);
+    i = (i - 1) / 2;
+  }
+}
+
+static void sift_down(int i) {
+  struct key_press *heap = key_merge_data.heap;
+  while (true) {
+    int min = i;
+    int l = 2 * i + 1;
+    int r = 2 * i + 2;
+    if (l < key_merge_data.len && heap[l].ns < heap[min].ns)
+      min = l;
+    if (r < key_merge_data.len && heap[r].ns < heap[min].ns)
+      min = r;
+    if (min == i)
+      return;
+    swap(&heap[i], &heap[min]);
+    i = min;
+  }
+}
+
+static struct key_press pop_min(void) {
+  struct key_press min = key_merge_data.heap[0];
+  key_merge_data.heap[0] = key_merge_data.heap[--key_merge_data.len];
+  sift_down(0);
+  return min;
+}
+
+int key_merge_push(struct key_press *key, struct key_press *evicted) {
+  int ret = 0;
+
+  if (key_merge_data.len == key_merge_capacity) {
+    *evicted = pop_min();
+    ret = 1;
+  }
+
+  key_merge_data.heap[key_merge_data.len++] = *key;
+  sift_up(key_merge_data.len - 1);
+  return ret;
+}
+
+int key_merge_pop(int64_t until, struct key_press *out) {
+  if (key_merge_data.len == 0 || key_merge_data.heap[0].ns > until)
+    return 1;
+
+  *out = pop_min();
+  return 0;
+}
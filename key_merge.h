@@ -0,0 +1,27 @@
+#ifndef QUA_KEY_MERGE_H
+#define QUA_KEY_MERGE_H
+
+#include <stdint.h>
+
+struct key_press {
+  int64_t ns; /* press time */
+  int key_class;
+  int group; /* device group id, or -1 */
+};
+
+/*
+ * key_merge is a reorder buffer for key presses from all devices, ordered
+ * by press time. Each device delivers its keys in order, so this merges several
+ * ordered streams. Not thread-safe; only used by the stats thread.
+ */
+
+/*
+ * key_merge_push adds a key press. If the buffer is full, the oldest one is
+ * evicted into *evicted and 1 is returned. Otherwise returns 0.
+ */
+int key_merge_push(struct key_press *key, struct key_press *evicted);
+
+/* key_merge_pop removes the oldest key if pressed <= until. Returns 0 if so. */
+int key_merge_pop(int64_t until, struct key_press *out);
+
+#endif
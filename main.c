@@ -2,7 +2,9 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#include "baseline.h"
 #include "dev_input_set.h"
+#include "device_group.h"
 #include "inotify_thread.h"
 #include "stats_thread.h"
 #include "stats_flush_thread.h"
@@ -22,6 +24,19 @@ int main(int argc, char **argv)
 		goto out; /* Error */
 	}
 
+	if (0 != stats_thread_init()) {
+		goto out; /* Error */
+	}
+
+	if (0 != device_group_init()) {
+		goto out; /* Error */
+	}
+
+	/* Needs the interval length, so must come after its init. */
+	if (0 != baseline_init()) {
+		goto out; /* Error */
+	}
+
 	/*
 	 * Mask all signals before starting other threads.
 	 * Child threads inherit main thread's signal mask.
@@ -66,6 +81,7 @@ int main(int argc, char **argv)
 	rc = 0;
 
 out:
+	baseline_fini();
 	journal_fini();
 
 	return rc;
@@ -0,0 +1,677 @@
+/*
+ * quantified-typing-merge merges journals (e.g. from several machines, or
+ * reinstalls and backups of one) into one journal, ordered by time.
+ *
+ * Usage: quantified-typing-merge [-p sum|dedup] [-i interval] journal...
+ *
+ * Inputs are merged with a k-way merge, so memory use does not depend on
+ * their size. Each input must be ordered by time, as the daemon writes it.
+ * Records of all inputs are aligned to the coarsest interval among them
+ * (or -i, in seconds). Records falling into the same interval are summed.
+ * With -p dedup, records with identical start times are considered copies
+ * of the same data (e.g. a backup), and only the largest one is kept.
+ *
+ * Besides "e", the key classes ("c"), corrections ("b"), queue latency
+ * ("q") and rate series ("r") are summed. Other fields (e.g. the baseline
+ * score "a") are only kept if a single record makes up the merged one.
+ * Dropped fields are reported on stderr.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "histogram.h"
+#include "qtjournal.h"
+#include "rate_series.h"
+
+enum merge_policy {
+  MERGE_POLICY_SUM,
+  MERGE_POLICY_DEDUP,
+};
+
+struct input {
+  const char *path;
+  struct qtj_journal journal;
+  struct qtj_iter it;
+  struct qtj_record rec;
+
+  /* aligned_ms is rec.t_ms, aligned to the output interval. */
+  int64_t aligned_ms;
+};
+
+/* Min-heap of inputs by (aligned_ms, t_ms); each input is in it at most once */
+static struct input **heap;
+static int heap_len;
+
+static int64_t interval_ms;
+
+/* Same limit as $INTERVAL of the daemon */
+static const int64_t max_interval_ms = 60 * 60 * 24 * 1000LL;
+
+/* hist is the output interval being merged, starting at hist_ms. */
+static int64_t hist[num_buckets];
+static int64_t hist_keys;
+static int64_t hist_ms;
+
+/* num_merged counts the records merged into hist. */
+static int num_merged;
+
+enum { max_key_classes = 16, max_key_class_len = 32 };
+
+/* key_class counts the keys per class ("c") of hist. */
+static struct {
+  char name[max_key_class_len];
+  int64_t count;
+} key_class[max_key_classes];
+static int num_key_classes;
+static bool key_class_missing; /* Some record of hist had keys, but no "c" */
+
+/* correction_hist sums the corrections ("b") of hist. */
+static int64_t correction_hist[num_buckets];
+static int64_t correction_keys;
+
+/* queue_latency[i] counts latencies below 2^i usec ("q"), plus "inf". */
+enum { num_queue_latency_buckets = 64 };
+static int64_t queue_latency[num_queue_latency_buckets];
+static int64_t queue_latency_inf;
+static bool have_queue_latency;
+static bool queue_latency_malformed;
+
+/* rate sums the rate series ("r") of hist, rate_len_sec seconds long. */
+static uint16_t *rate;
+static uint16_t *rate_tmp;
+static int rate_len_sec;
+static int num_rate;
+static bool have_rate;
+static bool rate_missing; /* Some record of hist had keys, but no usable "r" */
+static char *rate_buf;
+static size_t rate_buf_len;
+
+/* other holds the remaining fields of the records of hist. */
+enum { max_other_fields = 16 };
+static struct qtj_kv other[max_other_fields];
+static int num_other;
+
+/*
+ * dedup_rec is the largest record seen so far with its start time, if
+ * have_dedup. It is added to hist once all copies have been seen.
+ */
+static struct qtj_record dedup_rec;
+static bool have_dedup;
+
+/* warned holds the fields that were dropped, to report each only once. */
+enum { max_warned = 16 };
+static char warned[max_warned][max_key_class_len];
+static int num_warned;
+
+static bool input_less(const struct input *a, const struct input *b) {
+  if (a->aligned_ms != b->aligned_ms)
+    return a->aligned_ms < b->aligned_ms;
+  return a->rec.t_ms < b->rec.t_ms;
+}
+
+static void heap_swap(int a, int b) {
+  struct input *tmp = heap[a];
+  heap[a] = heap[b];
+  heap[b] = tmp;
+}
+
+static void heap_sift_down(int i) {
+  while (true) {
+    int min = i;
+    int l = 2 * i + 1;
+    int r = 2 * i + 2;
+    if (l < heap_len && input_less(heap[l], heap[min]))
+      min = l;
+    if (r < heap_len && input_less(heap[r], heap[min]))
+      min = r;
+    if (min == i)
+      return;
+    heap_swap(i, min);
+    i = min;
+  }
+}
+
+static void heap_sift_up(int i) {
+  while (i > 0 && input_less(heap[i], heap[(i - 1) / 2])) {
+    heap_swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+/* align rounds t_ms down to the start of its output interval. */
+static int64_t align(int64_t t_ms) {
+  int64_t r = t_ms % interval_ms;
+  return r < 0 ? t_ms - r - interval_ms : t_ms - r;
+}
+
+/* input_advance reads the next interval of in. Returns 0 at the end. */
+static int input_advance(struct input *in) {
+  while (qtj_next(&in->it, &in->rec)) {
+    if (in->rec.window_sec != 0)
+      continue; /* Sliding windows overlap intervals */
+    if (in->rec.group)
+      continue; /* Already counted in the interval's record */
+    in->aligned_ms = align(in->rec.t_ms);
+    return 1;
+  }
+
+  return 0;
+}
+
+static int64_t gcd(int64_t a, int64_t b) {
+  while (b) {
+    int64_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+/*
+ * detect_interval_ms guesses the interval of a journal. Interval starts are
+ * multiples of it, so it is the gcd of the distances between them (given
+ * any two adjacent intervals). Returns 0 if unknown (e.g. a single record).
+ * This reads the whole journal once, in constant memory.
+ */
+static int64_t detect_interval_ms(struct input *in) {
+  int64_t g = 0;
+  int64_t prev_ms = 0;
+  bool have_prev = false;
+
+  while (qtj_next(&in->it, &in->rec)) {
+    if (in->rec.window_sec != 0 || in->rec.group)
+      continue;
+    if (have_prev && in->rec.t_ms != prev_ms)
+      g = gcd(g, in->rec.t_ms > prev_ms ? in->rec.t_ms - prev_ms
+                                        : prev_ms - in->rec.t_ms);
+    prev_ms = in->rec.t_ms;
+    have_prev = true;
+  }
+
+  qtj_iter_init(&in->it, &in->journal);
+
+  if (g > max_interval_ms)
+    return 0; /* Not enough adjacent intervals to tell */
+  return g;
+}
+
+static bool key_is(const struct qtj_kv *kv, const char *key) {
+  return kv->key_len == strlen(key) && 0 == memcmp(kv->key, key, kv->key_len);
+}
+
+/* warn_dropped reports that field key was dropped from some records. */
+static void warn_dropped(const char *key, size_t key_len, const char *why) {
+  for (int i = 0; i < num_warned; i++)
+    if (strlen(warned[i]) == key_len && 0 == memcmp(warned[i], key, key_len))
+      return;
+
+  if (num_warned < max_warned && key_len < max_key_class_len) {
+    memcpy(warned[num_warned], key, key_len);
+    warned[num_warned][key_len] = '\0';
+    num_warned++;
+  }
+
+  fprintf(stderr, "warn: dropped \"%.*s\" of some records: %s\n",
+          (int)key_len, key, why);
+}
+
+static void key_class_add(const struct qtj_kv *field) {
+  const char *pos = NULL;
+  struct qtj_kv kv;
+  int ret;
+
+  while (1 == (ret = qtj_next_count(field->value, field->value_len, &pos,
+                                    &kv))) {
+    int i = 0;
+    while (i < num_key_classes &&
+           !(strlen(key_class[i].name) == kv.key_len &&
+             0 == memcmp(key_class[i].name, kv.key, kv.key_len)))
+      i++;
+
+    if (i == num_key_classes) {
+      if (i == max_key_classes || kv.key_len >= max_key_class_len) {
+        key_class_missing = true;
+        warn_dropped("c", 1, "too many key classes");
+        continue;
+      }
+      memcpy(key_class[i].name, kv.key, kv.key_len);
+      key_class[i].name[kv.key_len] = '\0';
+      key_class[i].count = 0;
+      num_key_classes++;
+    }
+
+    key_class[i].count += kv.count;
+  }
+
+  if (ret < 0) {
+    key_class_missing = true;
+    warn_dropped("c", 1, "malformed");
+  }
+}
+
+static void queue_latency_add(const struct qtj_kv *field) {
+  const char *pos = NULL;
+  struct qtj_kv kv;
+  int ret;
+
+  have_queue_latency = true;
+
+  while (1 == (ret = qtj_next_count(field->value, field->value_len, &pos,
+                                    &kv))) {
+    if (key_is(&kv, "inf")) {
+      queue_latency_inf += kv.count;
+      continue;
+    }
+
+    /* Buckets are named by their upper bound, a power of 2 */
+    uint64_t usec = strtoull(kv.key, NULL, 10);
+    if (usec == 0 || (usec & (usec - 1)) != 0) {
+      queue_latency_malformed = true;
+      continue;
+    }
+    queue_latency[__builtin_ctzll(usec)] += kv.count;
+  }
+
+  if (ret < 0)
+    queue_latency_malformed = true;
+}
+
+static void rate_add(const struct qtj_record *rec) {
+  int64_t offset_ms = rec->t_ms - hist_ms;
+
+  have_rate = true;
+
+  if (offset_ms % 1000 != 0) {
+    rate_missing = true;
+    warn_dropped("r", 1, "records start within a second of the merged one");
+    return;
+  }
+
+  int offset_sec = offset_ms / 1000;
+  int max = rate_len_sec - offset_sec;
+
+  /* One more, to tell whether it fits */
+  int n = qtj_rate(rec, rate_tmp, max + 1);
+  if (n < 0) {
+    rate_missing = true;
+    warn_dropped("r", 1, "malformed");
+    return;
+  }
+  if (n > max) {
+    rate_missing = true;
+    warn_dropped("r", 1, "longer than the merged interval");
+    return;
+  }
+
+  for (int i = 0; i < n; i++) {
+    int sum = rate[offset_sec + i] + rate_tmp[i];
+    rate[offset_sec + i] = sum > UINT16_MAX ? UINT16_MAX : sum;
+  }
+  if (offset_sec + n > num_rate)
+    num_rate = offset_sec + n;
+}
+
+/* interval_add merges rec into hist. */
+static void interval_add(const struct qtj_record *rec) {
+  const char *pos = NULL;
+  struct qtj_kv kv;
+  bool have_c = false;
+  bool have_r = false;
+
+  qtj_merge(hist, rec);
+  hist_keys += rec->num_keys;
+  num_merged++;
+
+  while (1 == qtj_next_field(rec, &pos, &kv)) {
+    if (key_is(&kv, "t") || key_is(&kv, "l") || key_is(&kv, "e")) {
+      continue; /* Written anyway */
+    } else if (key_is(&kv, "c")) {
+      have_c = true;
+      key_class_add(&kv);
+    } else if (key_is(&kv, "b")) {
+      int64_t n = qtj_merge_field(correction_hist, rec, "b");
+      if (n < 0)
+        warn_dropped("b", 1, "malformed");
+      else
+        correction_keys += n;
+    } else if (key_is(&kv, "q")) {
+      queue_latency_add(&kv);
+    } else if (key_is(&kv, "r")) {
+      have_r = true;
+      rate_add(rec);
+    } else if (num_other < max_other_fields) {
+      other[num_other++] = kv;
+    } else {
+      warn_dropped(kv.key, kv.key_len, "too many fields");
+    }
+  }
+
+  if (!have_c && rec->num_keys > 0)
+    key_class_missing = true;
+  if (!have_r && rec->num_keys > 0)
+    rate_missing = true;
+}
+
+static void dedup_flush(void) {
+  if (!have_dedup)
+    return;
+
+  interval_add(&dedup_rec);
+  have_dedup = false;
+}
+
+static void dedup_add(const struct qtj_record *rec) {
+  if (have_dedup && rec->t_ms != dedup_rec.t_ms)
+    dedup_flush();
+
+  if (!have_dedup || rec->num_keys > dedup_rec.num_keys) {
+    dedup_rec = *rec;
+    have_dedup = true;
+  }
+}
+
+static void write_histogram(const int64_t *h) {
+  char bucket_name[32];
+  bool not_first = false;
+
+  printf("{");
+  for (int i = 0; i < num_buckets; i++) {
+    if (h[i] <= 0)
+      continue;
+    histogram_index_to_bucket_name(i, bucket_name, sizeof(bucket_name));
+    printf("%s\"%s\":%" PRId64, not_first ? "," : "", bucket_name, h[i]);
+    not_first = true;
+  }
+  printf("}");
+}
+
+static void write_key_classes(void) {
+  if (num_key_classes == 0)
+    return;
+  if (key_class_missing) {
+    warn_dropped("c", 1, "missing from some of the merged records");
+    return;
+  }
+
+  printf(",\"c\":{");
+  for (int i = 0; i < num_key_classes; i++)
+    printf("%s\"%s\":%" PRId64, i ? "," : "", key_class[i].name,
+           key_class[i].count);
+  printf("}");
+}
+
+static void write_other_fields(void) {
+  for (int i = 0; i < num_other; i++) {
+    if (num_merged > 1)
+      warn_dropped(other[i].key, other[i].key_len, "cannot be merged");
+    else
+      printf(",\"%.*s\":%.*s", (int)other[i].key_len, other[i].key,
+             (int)other[i].value_len, other[i].value);
+  }
+}
+
+static void write_queue_latency(void) {
+  bool not_first = false;
+
+  if (!have_queue_latency)
+    return;
+  if (queue_latency_malformed) {
+    warn_dropped("q", 1, "malformed");
+    return;
+  }
+
+  printf(",\"q\":{");
+  for (int i = 0; i < num_queue_latency_buckets; i++) {
+    if (queue_latency[i] <= 0)
+      continue;
+    printf("%s\"%llu\":%" PRId64, not_first ? "," : "", 1ULL << i,
+           queue_latency[i]);
+    not_first = true;
+  }
+  if (queue_latency_inf > 0)
+    printf("%s\"inf\":%" PRId64, not_first ? "," : "", queue_latency_inf);
+  printf("}");
+}
+
+static int write_rate(void) {
+  if (!have_rate)
+    return 0;
+  if (rate_missing) {
+    warn_dropped("r", 1, "missing from some of the merged records");
+    return 0;
+  }
+  if (num_rate == 0)
+    return 0;
+
+  if (0 > rate_series_encode(rate, num_rate, rate_buf, rate_buf_len))
+    return 1;
+  printf(",\"r\":\"%s\"", rate_buf);
+  return 0;
+}
+
+/* interval_reset clears hist and all other fields. */
+static void interval_reset(void) {
+  memset(hist, 0, sizeof(hist));
+  hist_keys = 0;
+  num_merged = 0;
+
+  num_key_classes = 0;
+  key_class_missing = false;
+
+  memset(correction_hist, 0, sizeof(correction_hist));
+  correction_keys = 0;
+
+  memset(queue_latency, 0, sizeof(queue_latency));
+  queue_latency_inf = 0;
+  have_queue_latency = false;
+  queue_latency_malformed = false;
+
+  memset(rate, 0, rate_len_sec * sizeof(*rate));
+  num_rate = 0;
+  have_rate = false;
+  rate_missing = false;
+
+  num_other = 0;
+}
+
+/* write_record writes hist as a journal line, and resets it. */
+static int write_record(void) {
+  char local_str[64];
+  struct tm local;
+  int64_t t_ms = hist_ms;
+  time_t t = t_ms / 1000;
+
+  dedup_flush();
+
+  if (hist_keys <= 0) {
+    interval_reset();
+    return 0;
+  }
+
+  localtime_r(&t, &local);
+  strftime(local_str, sizeof(local_str), "%Y-%m-%d %H:%M:%S", &local);
+
+  if (interval_ms % 1000 != 0)
+    printf("{\"t\":\"%" PRId64 ".%03" PRId64 "\",\"l\":\"%s\",\"e\":",
+           t_ms / 1000, t_ms % 1000, local_str);
+  else
+    printf("{\"t\":\"%" PRId64 "\",\"l\":\"%s\",\"e\":", t_ms / 1000,
+           local_str);
+  write_histogram(hist);
+
+  /* Same order as the daemon */
+  write_key_classes();
+  if (correction_keys > 0) {
+    printf(",\"b\":");
+    write_histogram(correction_hist);
+  }
+  write_other_fields();
+  write_queue_latency();
+  if (0 != write_rate())
+    return 1;
+
+  printf("}\n");
+
+  interval_reset();
+
+  return ferror(stdout) ? 1 : 0;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr, "usage: %s [-p sum|dedup] [-i interval] journal...\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  enum merge_policy policy = MERGE_POLICY_SUM;
+  int rc = 1; /* Error */
+  int opt;
+
+  while ((opt = getopt(argc, argv, "p:i:h")) != -1) {
+    switch (opt) {
+    case 'p':
+      if (0 == strcmp(optarg, "sum")) {
+        policy = MERGE_POLICY_SUM;
+      } else if (0 == strcmp(optarg, "dedup")) {
+        policy = MERGE_POLICY_DEDUP;
+      } else {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'i':
+      interval_ms = (int64_t)(strtod(optarg, NULL) * 1000 + 0.5);
+      if (interval_ms <= 0 || interval_ms > max_interval_ms) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  int num_inputs = argc - optind;
+  if (num_inputs < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  struct input *inputs = calloc(num_inputs, sizeof(*inputs));
+  heap = calloc(num_inputs, sizeof(*heap));
+  if (!inputs || !heap) {
+    fprintf(stderr, "error: %m\n");
+    goto out_1;
+  }
+
+  int num_open = 0;
+  for (; num_open < num_inputs; num_open++) {
+    struct input *in = &inputs[num_open];
+    in->path = argv[optind + num_open];
+    if (0 != qtj_open(&in->journal, in->path)) {
+      fprintf(stderr, "error: failed to open %s: %m\n", in->path);
+      goto out_2;
+    }
+    qtj_iter_init(&in->it, &in->journal);
+  }
+
+  /*
+   * Align to the coarsest interval. Intervals divide or are multiples of
+   * 60s, but e.g. 4s and 6s still need their lcm (12s) to line up.
+   */
+  if (!interval_ms) {
+    int first = -1;
+    int64_t first_ms = 0;
+
+    for (int i = 0; i < num_inputs; i++) {
+      int64_t in_interval_ms = detect_interval_ms(&inputs[i]);
+      if (in_interval_ms <= 0)
+        continue;
+
+      /* Sparse journals look coarser than they are; -i fixes that */
+      if (first >= 0 && in_interval_ms != first_ms)
+        fprintf(stderr,
+                "warn: %s looks like %gs intervals, but %s like %gs; "
+                "use -i to choose the interval\n",
+                inputs[i].path, in_interval_ms / 1000.0, inputs[first].path,
+                first_ms / 1000.0);
+      if (first < 0) {
+        first = i;
+        first_ms = in_interval_ms;
+      }
+
+      if (interval_ms > 0)
+        interval_ms = interval_ms / gcd(interval_ms, in_interval_ms) *
+                      in_interval_ms;
+      else
+        interval_ms = in_interval_ms;
+    }
+  }
+  if (!interval_ms)
+    interval_ms = 1000; /* Unknown; at least don't write fractions */
+
+  rate_len_sec = (interval_ms + 999) / 1000;
+  rate_buf_len = rate_len_sec * rate_series_max_token_len + 1;
+  rate = calloc(rate_len_sec, sizeof(*rate));
+  rate_tmp = calloc(rate_len_sec + 1, sizeof(*rate_tmp));
+  rate_buf = malloc(rate_buf_len);
+  if (!rate || !rate_tmp || !rate_buf) {
+    fprintf(stderr, "error: %m\n");
+    goto out_2;
+  }
+
+  for (int i = 0; i < num_inputs; i++) {
+    if (input_advance(&inputs[i])) {
+      heap[heap_len++] = &inputs[i];
+      heap_sift_up(heap_len - 1);
+    }
+  }
+
+  while (heap_len > 0) {
+    struct input *in = heap[0];
+
+    if (in->aligned_ms != hist_ms) {
+      if (0 != write_record())
+        goto out_2;
+      hist_ms = in->aligned_ms;
+    }
+
+    if (policy == MERGE_POLICY_DEDUP) {
+      dedup_add(&in->rec);
+    } else {
+      interval_add(&in->rec);
+    }
+
+    if (!input_advance(in))
+      heap[0] = heap[--heap_len];
+    heap_sift_down(0);
+  }
+
+  if (0 != write_record())
+    goto out_2;
+
+  for (int i = 0; i < num_inputs; i++)
+    if (inputs[i].it.malformed)
+      fprintf(stderr, "warn: %s: skipped %zu malformed lines\n",
+              inputs[i].path, inputs[i].it.malformed);
+
+  rc = 0; /* Success */
+
+out_2:
+  for (int i = 0; i < num_open; i++)
+    qtj_close(&inputs[i].journal);
+out_1:
+  free(rate_buf);
+  free(rate_tmp);
+  free(rate);
+  free(heap);
+  free(inputs);
+  return rc;
+}
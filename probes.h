@@ -0,0 +1,33 @@
+#ifndef QUA_PROBES_H
+#define QUA_PROBES_H
+
+/*
+ * USDT tracepoints, e.g. for bpftrace:
+ *
+ *   bpftrace -e 'usdt:/usr/bin/quantified-typing:quantified_typing:* { ... }'
+ *
+ * They are a single nop unless a tracer is attached.
+ * Without <sys/sdt.h> at build time they compile to nothing.
+ */
+
+#ifdef HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define QUA_PROBE(name) DTRACE_PROBE(quantified_typing, name)
+#define QUA_PROBE1(name, a) DTRACE_PROBE1(quantified_typing, name, a)
+#define QUA_PROBE2(name, a, b) DTRACE_PROBE2(quantified_typing, name, a, b)
+#define QUA_PROBE3(name, a, b, c) DTRACE_PROBE3(quantified_typing, name, a, b, c)
+
+#else
+
+/* sizeof() keeps arguments "used" without evaluating them. */
+#define QUA_PROBE(name) do {} while (0)
+#define QUA_PROBE1(name, a) do { (void)sizeof(a); } while (0)
+#define QUA_PROBE2(name, a, b) do { (void)sizeof(a); (void)sizeof(b); } while (0)
+#define QUA_PROBE3(name, a, b, c) \
+  do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,484 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "histogram.h"
+
+#include "qtjournal.h"
+
+_Static_assert(QTJ_NUM_BUCKETS == num_buckets, "bucket count mismatch");
+_Static_assert(QTJ_BUCKET_WIDTH_MS == bucket_width_ms, "bucket width mismatch");
+
+int qtj_open(struct qtj_journal *journal, const char *path) {
+  struct stat st;
+
+  journal->data = NULL;
+  journal->len = 0;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  if (0 != fstat(fd, &st)) {
+    close(fd);
+    return -1;
+  }
+
+  /* Mapping an empty file fails, but an empty journal is fine. */
+  if (st.st_size > 0) {
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      return -1;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    journal->data = data;
+    journal->len = st.st_size;
+  }
+
+  close(fd);
+  return 0;
+}
+
+void qtj_close(struct qtj_journal *journal) {
+  if (journal->data)
+    munmap((void *)journal->data, journal->len);
+  journal->data = NULL;
+  journal->len = 0;
+}
+
+/* parse_int parses an optionally negative decimal at *p, advancing *p. */
+static int parse_int(const char **p, const char *end, int64_t *out) {
+  bool negative = false;
+  int64_t v = 0;
+
+  if (*p < end && **p == '-') {
+    negative = true;
+    (*p)++;
+  }
+
+  const char *start = *p;
+  while (*p < end && **p >= '0' && **p <= '9') {
+    v = v * 10 + (**p - '0');
+    (*p)++;
+  }
+  if (*p == start)
+    return -1;
+
+  *out = negative ? -v : v;
+  return 0;
+}
+
+/* skip_string advances *p past the string starting at *p. */
+static int skip_string(const char **p, const char *end) {
+  if (*p >= end || **p != '"')
+    return -1;
+
+  for ((*p)++; *p < end; (*p)++) {
+    if (**p == '\\') {
+      (*p)++;
+    } else if (**p == '"') {
+      (*p)++;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* skip_value advances *p past the value (string, object or scalar) at *p. */
+static int skip_value(const char **p, const char *end) {
+  if (*p < end && **p == '"')
+    return skip_string(p, end);
+
+  if (*p < end && **p == '{') {
+    int depth = 0;
+    while (*p < end) {
+      if (**p == '"') {
+        if (skip_string(p, end))
+          return -1;
+        continue;
+      }
+      if (**p == '{')
+        depth++;
+      if (**p == '}' && --depth == 0) {
+        (*p)++;
+        return 0;
+      }
+      (*p)++;
+    }
+    return -1;
+  }
+
+  while (*p < end && **p != ',' && **p != '}')
+    (*p)++;
+  return 0;
+}
+
+/* parse_t parses "t", seconds with optional msec fraction, e.g. 1.250 */
+static int parse_t(const char *p, const char *end, int64_t *t_ms) {
+  int64_t sec;
+  int64_t ms = 0;
+
+  if (parse_int(&p, end, &sec))
+    return -1;
+
+  if (p < end && *p == '.') {
+    int digits = 0;
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+      if (digits++ < 3)
+        ms = ms * 10 + (*p - '0');
+    }
+    for (; digits < 3; digits++)
+      ms *= 10;
+  }
+
+  *t_ms = sec * 1000 + ms;
+  return 0;
+}
+
+/* parse_buckets parses the "e" object at *p into rec. */
+static int parse_buckets(const char **p, const char *end,
+                         struct qtj_record *rec) {
+  rec->num_pairs = 0;
+  rec->num_keys = 0;
+
+  if (*p >= end || **p != '{')
+    return -1;
+  (*p)++;
+
+  while (*p < end && **p != '}') {
+    int64_t ms;
+    int64_t count;
+    int bucket;
+
+    if (**p != '"')
+      return -1;
+    (*p)++;
+
+    if (end - *p >= 3 && 0 == memcmp(*p, "inf", 3)) {
+      bucket = num_regular_buckets;
+      *p += 3;
+    } else {
+      if (parse_int(p, end, &ms))
+        return -1;
+      /* Clamp first, so that the conversion to int cannot overflow. */
+      bucket = histogram_index_from_msec(ms > max_bucket_ms ? max_bucket_ms + 1
+                                                            : ms);
+    }
+
+    if (end - *p < 2 || (*p)[0] != '"' || (*p)[1] != ':')
+      return -1;
+    *p += 2;
+
+    if (parse_int(p, end, &count))
+      return -1;
+
+    if (rec->num_pairs == QTJ_NUM_BUCKETS)
+      return -1; /* duplicate buckets */
+    rec->pair[rec->num_pairs].bucket = bucket;
+    rec->pair[rec->num_pairs].count = count;
+    rec->num_pairs++;
+    rec->num_keys += count;
+
+    if (*p < end && **p == ',')
+      (*p)++;
+  }
+
+  if (*p >= end)
+    return -1;
+  (*p)++;
+  return 0;
+}
+
+/* parse_line parses one journal line. Returns 0 on success, -1 if malformed. */
+static int parse_line(const char *p, const char *end, struct qtj_record *rec) {
+  bool have_t = false;
+  bool have_e = false;
+
+  rec->line = p;
+  rec->line_len = end - p;
+  rec->local = NULL;
+  rec->local_len = 0;
+  rec->window_sec = 0;
+  rec->group = NULL;
+  rec->group_len = 0;
+
+  if (p >= end || *p != '{')
+    return -1;
+  p++;
+
+  while (p < end && *p != '}') {
+    const char *key = p;
+    if (skip_string(&p, end))
+      return -1;
+    size_t key_len = p - key;
+
+    if (p >= end || *p != ':')
+      return -1;
+    p++;
+
+    const char *value = p;
+    if (key_len == 3 && key[1] == 'e') {
+      if (parse_buckets(&p, end, rec))
+        return -1;
+      have_e = true;
+    } else {
+      if (skip_value(&p, end))
+        return -1;
+    }
+
+    /* String values, without quotes */
+    const char *str = value + 1;
+    const char *str_end = p - 1;
+
+    if (key_len == 3 && key[1] == 't') {
+      if (*value != '"' || parse_t(str, str_end, &rec->t_ms))
+        return -1;
+      have_t = true;
+    } else if (key_len == 3 && key[1] == 'l' && *value == '"') {
+      rec->local = str;
+      rec->local_len = str_end - str;
+    } else if (key_len == 3 && key[1] == 'w' && *value == '"') {
+      int64_t w;
+      if (parse_int(&str, str_end, &w))
+        return -1;
+      rec->window_sec = w;
+    } else if (key_len == 3 && key[1] == 'g' && *value == '"') {
+      rec->group = str;
+      rec->group_len = str_end - str;
+    }
+
+    if (p < end && *p == ',')
+      p++;
+  }
+
+  return have_t && have_e ? 0 : -1;
+}
+
+void qtj_iter_init(struct qtj_iter *it, const struct qtj_journal *journal) {
+  it->journal = journal;
+  it->pos = journal->data;
+  it->malformed = 0;
+}
+
+static const char *journal_end(const struct qtj_iter *it) {
+  return it->journal->data + it->journal->len;
+}
+
+static const char *line_end(const char *p, const char *end) {
+  const char *eol = memchr(p, '\n', end - p);
+  return eol ? eol : end;
+}
+
+int qtj_next(struct qtj_iter *it, struct qtj_record *rec) {
+  const char *end = journal_end(it);
+
+  while (it->pos && it->pos < end) {
+    const char *eol = line_end(it->pos, end);
+    const char *line = it->pos;
+
+    it->pos = eol + 1;
+
+    if (eol == line)
+      continue; /* Empty line */
+    if (0 == parse_line(line, eol, rec))
+      return 1;
+    it->malformed++;
+  }
+
+  return 0;
+}
+
+void qtj_seek(struct qtj_iter *it, int64_t t_ms) {
+  const char *lo = it->journal->data;
+  const char *hi = journal_end(it);
+  struct qtj_record rec;
+
+  /* lo and hi are always at line starts; find the first line >= t_ms */
+  while (lo < hi) {
+    const char *mid = lo + (hi - lo) / 2;
+    while (mid > lo && mid[-1] != '\n')
+      mid--;
+
+    /* Compare against the first line from mid on that parses */
+    const char *p = mid;
+    const char *eol = line_end(p, hi);
+    while (0 != parse_line(p, eol, &rec)) {
+      p = eol < hi ? eol + 1 : hi;
+      if (p == hi)
+        break;
+      eol = line_end(p, hi);
+    }
+
+    /* Nothing from mid to hi parses, so there is nothing to bisect */
+    if (p == hi)
+      break;
+
+    if (rec.t_ms < t_ms)
+      lo = eol < hi ? eol + 1 : hi;
+    else
+      hi = mid;
+  }
+
+  /* Linear scan over what is left (usually nothing) */
+  while (lo < hi) {
+    const char *eol = line_end(lo, hi);
+    if (0 == parse_line(lo, eol, &rec) && rec.t_ms >= t_ms)
+      break;
+    lo = eol < hi ? eol + 1 : hi;
+  }
+
+  it->pos = lo;
+}
+
+int qtj_next_field(const struct qtj_record *rec, const char **pos,
+                   struct qtj_kv *kv) {
+  const char *p = *pos;
+  const char *end = rec->line + rec->line_len;
+
+  if (!p) {
+    p = rec->line;
+    if (p >= end || *p != '{')
+      return -1;
+    p++;
+  }
+
+  if (p >= end || *p == '}')
+    return 0;
+
+  const char *k = p;
+  if (skip_string(&p, end))
+    return -1;
+  if (p >= end || *p != ':')
+    return -1;
+  kv->key = k + 1;
+  kv->key_len = p - k - 2;
+  p++;
+
+  const char *v = p;
+  if (skip_value(&p, end))
+    return -1;
+  kv->value = v;
+  kv->value_len = p - v;
+
+  if (p < end && *p == ',')
+    p++;
+
+  *pos = p;
+  return 1;
+}
+
+int qtj_field(const struct qtj_record *rec, const char *key,
+              const char **value, size_t *value_len) {
+  const char *pos = NULL;
+  size_t key_len = strlen(key);
+  struct qtj_kv kv;
+
+  while (1 == qtj_next_field(rec, &pos, &kv)) {
+    if (kv.value_len > 0 && kv.key_len == key_len &&
+        0 == memcmp(kv.key, key, key_len)) {
+      *value = kv.value;
+      *value_len = kv.value_len;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+int qtj_next_count(const char *value, size_t value_len, const char **pos,
+                   struct qtj_kv *kv) {
+  const char *p = *pos;
+  const char *end = value + value_len;
+
+  if (!p) {
+    p = value;
+    if (p >= end || *p != '{')
+      return -1;
+    p++;
+  }
+
+  if (p >= end || *p == '}')
+    return 0;
+
+  const char *k = p;
+  if (skip_string(&p, end))
+    return -1;
+  if (p >= end || *p != ':')
+    return -1;
+  kv->key = k + 1;
+  kv->key_len = p - k - 2;
+  p++;
+
+  kv->value = p;
+  if (parse_int(&p, end, &kv->count))
+    return -1;
+  kv->value_len = p - kv->value;
+
+  if (p < end && *p == ',')
+    p++;
+
+  *pos = p;
+  return 1;
+}
+
+int64_t qtj_merge_field(int64_t hist[QTJ_NUM_BUCKETS],
+                        const struct qtj_record *rec, const char *key) {
+  struct qtj_record field;
+  const char *p;
+  size_t len;
+
+  if (0 != qtj_field(rec, key, &p, &len))
+    return -1;
+  if (parse_buckets(&p, p + len, &field))
+    return -1;
+
+  qtj_merge(hist, &field);
+  return field.num_keys;
+}
+
+int qtj_rate(const struct qtj_record *rec, uint16_t *out, int max) {
+  const char *p;
+  size_t len;
+  int64_t count = 0;
+  int n = 0;
+
+  if (0 != qtj_field(rec, "r", &p, &len))
+    return 0;
+  if (len < 2 || p[0] != '"' || p[len - 1] != '"')
+    return -1;
+
+  const char *end = p + len - 1;
+  for (p++; p < end; p++) {
+    int64_t delta;
+    int64_t run = 1;
+
+    if (parse_int(&p, end, &delta))
+      return -1;
+    if (p < end && *p == '*') {
+      p++;
+      if (parse_int(&p, end, &run) || run < 1)
+        return -1;
+    }
+    if (p < end && *p != ',')
+      return -1;
+
+    for (; run > 0 && n < max; run--) {
+      count += delta;
+      if (count < 0 || count > UINT16_MAX)
+        return -1;
+      out[n++] = count;
+    }
+  }
+
+  return n;
+}
+
+void qtj_merge(int64_t hist[QTJ_NUM_BUCKETS], const struct qtj_record *rec) {
+  for (int i = 0; i < rec->num_pairs; i++)
+    hist[rec->pair[i].bucket] += rec->pair[i].count;
+}
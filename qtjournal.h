@@ -0,0 +1,141 @@
+#ifndef QTJOURNAL_H
+#define QTJOURNAL_H
+
+/*
+ * libqtjournal reads journals written by quantified-typing (typing.log).
+ *
+ * The journal is mapped into memory, and records are parsed in place:
+ * iterating does not allocate. Strings in a record point into the mapping,
+ * and stay valid until qtj_close().
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Buckets are 0..1990ms in steps of 10ms, plus an overflow ("inf") bucket. */
+#define QTJ_BUCKET_WIDTH_MS 10
+#define QTJ_NUM_BUCKETS 201
+
+struct qtj_journal {
+  const char *data;
+  size_t len;
+};
+
+/* qtj_pair is a nonzero bucket of a record. */
+struct qtj_pair {
+  int bucket; /* index, 0 .. QTJ_NUM_BUCKETS - 1 */
+  int64_t count;
+};
+
+struct qtj_record {
+  /* t_ms is the interval start ("t"), in msec since the epoch. */
+  int64_t t_ms;
+
+  /* window_sec is the sliding window length ("w"), or 0 for intervals. */
+  int window_sec;
+
+  /* group is the device group ("g"), or NULL for all devices. Not NUL
+   * terminated. */
+  const char *group;
+  size_t group_len;
+
+  /* local is the local time of t ("l"), not NUL terminated. */
+  const char *local;
+  size_t local_len;
+
+  /* line is the whole record, without the newline. */
+  const char *line;
+  size_t line_len;
+
+  /* pair holds the nonzero buckets of "e", in file order. */
+  int num_pairs;
+  int64_t num_keys;
+  struct qtj_pair pair[QTJ_NUM_BUCKETS];
+};
+
+struct qtj_iter {
+  const struct qtj_journal *journal;
+  const char *pos;
+
+  /* malformed counts lines that were skipped. */
+  size_t malformed;
+};
+
+/* qtj_open maps the journal at path. Returns 0 on success, -1 on error. */
+int qtj_open(struct qtj_journal *journal, const char *path);
+
+void qtj_close(struct qtj_journal *journal);
+
+/* qtj_iter_init positions it at the first record. */
+void qtj_iter_init(struct qtj_iter *it, const struct qtj_journal *journal);
+
+/*
+ * qtj_next parses the next record into rec.
+ * Returns 1 if a record was read, 0 at the end. Malformed lines are skipped.
+ */
+int qtj_next(struct qtj_iter *it, struct qtj_record *rec);
+
+/*
+ * qtj_seek positions it at the first record with t_ms >= t_ms, by binary
+ * search. Assumes records are ordered by time, as the daemon writes them.
+ */
+void qtj_seek(struct qtj_iter *it, int64_t t_ms);
+
+/* qtj_kv is a field of a record, or an entry of an object of counts. */
+struct qtj_kv {
+  /* key is the name, without quotes, and not NUL terminated. */
+  const char *key;
+  size_t key_len;
+
+  /* value is the raw JSON value. */
+  const char *value;
+  size_t value_len;
+
+  /* count is the value as a number (qtj_next_count only). */
+  int64_t count;
+};
+
+/*
+ * qtj_next_field iterates over the top level fields of rec, in file order.
+ * Set *pos to NULL before the first call.
+ * Returns 1 if a field was read into kv, 0 at the end, -1 if malformed.
+ */
+int qtj_next_field(const struct qtj_record *rec, const char **pos,
+                   struct qtj_kv *kv);
+
+/*
+ * qtj_field finds the top level field key in rec, and returns its raw JSON
+ * value (e.g. a number, or an object including braces).
+ * Returns 0 if found, -1 otherwise.
+ */
+int qtj_field(const struct qtj_record *rec, const char *key,
+              const char **value, size_t *value_len);
+
+/*
+ * qtj_rate decodes the rate series ("r") of rec into out: the number of
+ * keys in each second of the interval. Seconds after the returned count
+ * have no keys. Returns the number of seconds written (at most max), 0 if
+ * rec has no rate series, or -1 if it is malformed.
+ */
+int qtj_rate(const struct qtj_record *rec, uint16_t *out, int max);
+
+/*
+ * qtj_next_count iterates over an object of counts, e.g. the value of "c" or
+ * "q" as returned by qtj_field. Set *pos to NULL before the first call.
+ * Returns 1 if an entry was read into kv, 0 at the end, -1 if malformed.
+ */
+int qtj_next_count(const char *value, size_t value_len, const char **pos,
+                   struct qtj_kv *kv);
+
+/* qtj_merge adds the buckets of rec to hist. */
+void qtj_merge(int64_t hist[QTJ_NUM_BUCKETS], const struct qtj_record *rec);
+
+/*
+ * qtj_merge_field adds the buckets of another histogram field of rec (e.g.
+ * "b") to hist. Returns the number of keys added, or -1 if rec has no such
+ * field or it is malformed.
+ */
+int64_t qtj_merge_field(int64_t hist[QTJ_NUM_BUCKETS],
+                        const struct qtj_record *rec, const char *key);
+
+#endif
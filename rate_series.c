@@ -0,0 +1,76 @@
+#include "rate_series.h"
+
+/* put_uint writes v in decimal at p, and returns the end. */
+static char *put_uint(char *p, unsigned v) {
+  char tmp[10];
+  int n = 0;
+
+  do {
+    tmp[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v);
+
+  while (n)
+    *p++ = tmp[--n];
+  return p;
+}
+
+/* put_run writes one token, a run of len deltas d, at p. */
+static char *put_run(char *p, int d, int len) {
+  if (d < 0) {
+    *p++ = '-';
+    d = -d;
+  }
+  p = put_uint(p, d);
+
+  if (len > 1) {
+    *p++ = '*';
+    p = put_uint(p, len);
+  }
+
+  *p++ = ',';
+  return p;
+}
+
+/*
+ * snprintf would dominate here, so numbers are formatted by hand. One pass,
+ * and idle stretches collapse into a single "0*n" token.
+ */
+int rate_series_encode(const uint16_t *count, int n, char *out,
+                       size_t out_len) {
+  char *p = out;
+  char *end = out + out_len;
+  int prev = 0;
+  int run_delta = 0;
+  int run_len = 0;
+
+  for (int i = 0; i < n; i++) {
+    int d = count[i] - prev;
+    prev = count[i];
+
+    if (run_len > 0 && d == run_delta) {
+      run_len++;
+      continue;
+    }
+
+    if (run_len > 0) {
+      if (end - p < rate_series_max_token_len)
+        return -1;
+      p = put_run(p, run_delta, run_len);
+    }
+    run_delta = d;
+    run_len = 1;
+  }
+
+  if (run_len > 0) {
+    if (end - p < rate_series_max_token_len)
+      return -1;
+    p = put_run(p, run_delta, run_len);
+    p--; /* No comma after the last token */
+  }
+
+  if (p >= end)
+    return -1;
+  *p = '\0';
+  return p - out;
+}
@@ -0,0 +1,26 @@
+#ifndef QUA_RATE_SERIES_H
+#define QUA_RATE_SERIES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A rate series is the number of keys in each second of an interval.
+ * It is written as comma separated deltas to the previous second (starting
+ * from 0), where a run of n equal deltas d is written as "d*n". Seconds
+ * after the last one written have no keys. E.g. 0,0,0,4,4,4,1 is
+ * "0*3,4,0*2,-3".
+ */
+
+/* Longest encoding of one second: "-65535*86400," */
+enum { rate_series_max_token_len = 16 };
+
+/*
+ * rate_series_encode encodes the first n seconds of count into out, NUL
+ * terminated. Returns the length, or -1 if out is too small. It never is
+ * if out_len > n * rate_series_max_token_len.
+ */
+int rate_series_encode(const uint16_t *count, int n, char *out,
+                       size_t out_len);
+
+#endif
@@ -0,0 +1,159 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sliding_window.h"
+
+/*
+ * The ring must cover the longest window, plus max_lag_sec seconds that
+ * already expired from it, for sliding_window_get_at().
+ */
+enum { max_lag_sec = 60, ring_len = 60 * 60 + max_lag_sec };
+
+const int sliding_window_len_sec[num_sliding_windows] = {60, 15 * 60, 60 * 60};
+
+/*
+ * Keys are counted in a ring of per-second sub-histograms, and in a running
+ * sum per window. When a second expires from a window, its sub-histogram is
+ * subtracted from that window's sum. So keeping all windows current costs
+ * O(num_buckets) per second with keys, and O(1) per idle second.
+ *
+ * Seconds are CLOCK_REALTIME seconds, so that windows can end exactly where
+ * an interval does.
+ */
+static struct {
+  /* slot[s % ring_len] is the distribution of second s. */
+  uint16_t (*slot)[num_buckets];
+
+  /* slot_keys[s % ring_len] is the number of keys in second s. */
+  int *slot_keys;
+
+  /* head_sec is the most recent second; slots after it are zero. */
+  time_t head_sec;
+  bool started;
+
+  /* sum[w] is the sum of the last sliding_window_len_sec[w] slots. */
+  struct histogram sum[num_sliding_windows];
+} sliding_window_data;
+
+int sliding_window_init(void) {
+  sliding_window_data.slot = calloc(ring_len, sizeof(*sliding_window_data.slot));
+  if (!sliding_window_data.slot) {
+    fprintf(stderr, "error: %m\n");
+    return 1;
+  }
+
+  sliding_window_data.slot_keys =
+      calloc(ring_len, sizeof(*sliding_window_data.slot_keys));
+  if (!sliding_window_data.slot_keys) {
+    fprintf(stderr, "error: %m\n");
+    free(sliding_window_data.slot);
+    sliding_window_data.slot = NULL;
+    return 1;
+  }
+
+  return 0;
+}
+
+static int slot_index(time_t sec) {
+  return ((sec % ring_len) + ring_len) % ring_len;
+}
+
+static void slot_clear(int s) {
+  if (sliding_window_data.slot_keys[s] == 0)
+    return;
+  memset(sliding_window_data.slot[s], 0, sizeof(sliding_window_data.slot[s]));
+  sliding_window_data.slot_keys[s] = 0;
+}
+
+/* slot_expire subtracts slot s from the sum of window w. */
+static void slot_expire(int s, int w) {
+  if (sliding_window_data.slot_keys[s] == 0)
+    return;
+  histogram_sub_dense(&sliding_window_data.sum[w], sliding_window_data.slot[s],
+                      sliding_window_data.slot_keys[s]);
+}
+
+void sliding_window_advance(time_t sec) {
+  if (!sliding_window_data.started) {
+    sliding_window_data.head_sec = sec;
+    sliding_window_data.started = true;
+    return;
+  }
+
+  if (sec <= sliding_window_data.head_sec)
+    return;
+
+  /* Idle for longer than the longest window: everything expired. */
+  if (sec - sliding_window_data.head_sec >= ring_len) {
+    for (int w = 0; w < num_sliding_windows; w++)
+      histogram_reset(&sliding_window_data.sum[w]);
+    for (int s = 0; s < ring_len; s++)
+      slot_clear(s);
+    sliding_window_data.head_sec = sec;
+    return;
+  }
+
+  while (sliding_window_data.head_sec < sec) {
+    time_t head = ++sliding_window_data.head_sec;
+
+    for (int w = 0; w < num_sliding_windows; w++)
+      slot_expire(slot_index(head - sliding_window_len_sec[w]), w);
+
+    /* This slot expired from the longest window max_lag_sec ago. */
+    slot_clear(slot_index(head));
+  }
+}
+
+void sliding_window_add(time_t sec, int idx) {
+  sliding_window_advance(sec);
+
+  /* Keys from the past (e.g. from a slower device thread) count as now. */
+  int s = slot_index(sliding_window_data.head_sec);
+
+  if (sliding_window_data.slot[s][idx] == UINT16_MAX)
+    return; /* Cannot be subtracted again; drop it */
+
+  sliding_window_data.slot[s][idx]++;
+  sliding_window_data.slot_keys[s]++;
+
+  for (int w = 0; w < num_sliding_windows; w++)
+    histogram_add(&sliding_window_data.sum[w], idx, 1);
+}
+
+const struct histogram *sliding_window_get(int w) {
+  return &sliding_window_data.sum[w];
+}
+
+/* slot_add adds slot s to h. */
+static void slot_add(struct histogram *h, int s) {
+  if (sliding_window_data.slot_keys[s] == 0)
+    return;
+  for (int idx = 0; idx < num_buckets; idx++)
+    if (sliding_window_data.slot[s][idx] > 0)
+      histogram_add(h, idx, sliding_window_data.slot[s][idx]);
+}
+
+int sliding_window_get_at(int w, time_t sec, struct histogram *out) {
+  time_t head = sliding_window_data.head_sec;
+  int len = sliding_window_len_sec[w];
+
+  *out = sliding_window_data.sum[w];
+  if (!sliding_window_data.started || sec >= head)
+    return 0; /* No keys after sec yet */
+  if (head - sec > max_lag_sec)
+    return 1;
+
+  /* Undo the seconds since sec: remove the newer ones, re-add the expired */
+  for (time_t t = sec + 1; t <= head; t++) {
+    int s = slot_index(t);
+    if (sliding_window_data.slot_keys[s] > 0)
+      histogram_sub_dense(out, sliding_window_data.slot[s],
+                          sliding_window_data.slot_keys[s]);
+    slot_add(out, slot_index(t - len));
+  }
+
+  return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef QUA_SLIDING_WINDOW_H
+#define QUA_SLIDING_WINDOW_H
+
+#include <time.h>
+
+#include "histogram.h"
+
+enum { num_sliding_windows = 3 };
+
+/* sliding_window_len_sec is the length of each window, shortest first. */
+extern const int sliding_window_len_sec[num_sliding_windows];
+
+/* sliding_window_init allocates the ring. Returns 1 on error. */
+int sliding_window_init(void);
+
+/* sliding_window_add counts a key in bucket idx at (realtime) second sec. */
+void sliding_window_add(time_t sec, int idx);
+
+/* sliding_window_advance expires all seconds up to (realtime) second sec. */
+void sliding_window_advance(time_t sec);
+
+/* sliding_window_get returns the distribution of window w (0 .. num-1). */
+const struct histogram *sliding_window_get(int w);
+
+/*
+ * sliding_window_get_at computes the distribution of window w as of the end
+ * of second sec into out, leaving out any keys counted since. Returns 1 if
+ * sec is too far back for that (more than a minute).
+ */
+int sliding_window_get_at(int w, time_t sec, struct histogram *out);
+
+#endif
@@ -2,46 +2,56 @@
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "stats_thread.h"
+#include "util.h"
 
 #include "stats_flush_thread.h"
 
 /* May be overwritten via $INTERVAL environment variable. */
-static long interval_sec = 300;
+static long interval_ms = 300 * 1000;
+
+/*
+ * Keys are credited to intervals by press time, so an interval is only
+ * closed grace_ms after its end, giving keys still in flight time to
+ * arrive.
+ */
+static long grace_ms = 1000;
+
+long stats_flush_thread_interval_ms(void) { return interval_ms; }
 
 static void *stats_flush_thread(void *arg) {
+  /* Start of the next interval to close */
+  long long begin_ms = realtime_ms();
+  begin_ms -= begin_ms % interval_ms;
+
   while (true) {
-    /* Current time (somewhere within some interval) */
-    struct timeval now;
-    struct timezone tz; /* Don't use this; it's deprecated */
-    if (0 != gettimeofday(&now, &tz)) {
-      fprintf(stderr, "warn: gettimeofday failed: %m\n");
+    long long wake_ms = begin_ms + interval_ms + grace_ms;
+    struct timespec wake = {
+        .tv_sec = wake_ms / 1000,
+        .tv_nsec = (wake_ms % 1000) * 1000000,
+    };
+
+    /* Absolute deadlines don't drift, and follow clock changes */
+    int rc;
+    do {
+      rc = clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &wake, NULL);
+    } while (rc == EINTR);
+    if (0 != rc) {
+      errno = rc;
+      fprintf(stderr, "warn: clock_nanosleep failed: %m\n");
       continue;
     }
-    struct tm now_local;
-    localtime_r(&now.tv_sec, &now_local);
 
-    /* Begin/end of current interval */
-    struct timeval begin = {
-        .tv_sec = now.tv_sec - (now.tv_sec % interval_sec),
-        .tv_usec = 0,
-    };
-    struct timeval end = {
-        .tv_sec = begin.tv_sec + interval_sec,
-        .tv_usec = 0,
-    };
+    stats_thread_submit_flush(begin_ms);
 
-    /* Sleep until start of next interval */
-    struct timeval delta = {
-        .tv_sec = end.tv_sec - (now.tv_sec + 1),
-        .tv_usec = 1000000 - now.tv_usec,
-    };
-    usleep(delta.tv_sec * 1000000 + delta.tv_usec);
-
-    /* End previous interval, start new interval */
-    stats_thread_submit_flush(begin, now_local);
+    /* Normally the next interval; after a clock change, the current one. */
+    begin_ms = realtime_ms() - grace_ms;
+    begin_ms -= begin_ms % interval_ms;
   }
 }
 
@@ -79,30 +89,49 @@ out_1:
   return ret;
 }
 
+/*
+ * $INTERVAL is in seconds, unless suffixed with "ms" (milliseconds) or "s".
+ * It must be between 100ms and 86400s, and a multiple or divisor of 60s.
+ */
 int status_flush_thread_init(void) {
   char *interval_str;
-  int interval;
+  char *unit;
+  long interval;
 
   interval_str = getenv("INTERVAL");
   if (!interval_str)
     return 0;
 
-  interval = atol(interval_str);
+  interval = strtol(interval_str, &unit, 10);
   if (!interval)
     return 0;
 
-  if (interval < 1 || interval > 60 * 60 * 24) {
-    fprintf(stderr, "error: bad interval: $d. must be between 1 and 86400.\n",
-            interval);
+  if (0 == strcmp(unit, "ms")) {
+    /* already in milliseconds */
+  } else if (0 == strcmp(unit, "") || 0 == strcmp(unit, "s")) {
+    interval *= 1000;
+  } else {
+    fprintf(stderr, "error: bad interval: %s. unit must be s or ms.\n",
+            interval_str);
+    return 1;
+  }
+
+  if (interval < 100 || interval > 60 * 60 * 24 * 1000L) {
+    fprintf(stderr,
+            "error: bad interval: %s. must be between 100ms and 86400s.\n",
+            interval_str);
     return 1;
   }
-  if (interval < 60 ? 60 % interval != 0 : interval % 60 != 0) {
-    fprintf(stderr, "error: bad interval: $d. must be a multiple or divisor of 60.\n",
-            interval);
+  if (interval < 60 * 1000 ? 60 * 1000 % interval != 0
+                           : interval % (60 * 1000) != 0) {
+    fprintf(stderr,
+            "error: bad interval: %s. must be a multiple or divisor of 60s.\n",
+            interval_str);
     return 1;
   }
 
-  interval_sec = interval;
+  interval_ms = interval;
+  grace_ms = interval_ms / 2 < 1000 ? interval_ms / 2 : 1000;
 
   return 0;
-}
\ No newline at end of file
+}
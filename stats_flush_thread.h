@@ -4,4 +4,7 @@
 int spawn_stats_flush_thread(void);
 int status_flush_thread_init(void);
 
+/* stats_flush_thread_interval_ms returns the configured interval length. */
+long stats_flush_thread_interval_ms(void);
+
 #endif
\ No newline at end of file
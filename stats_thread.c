@@ -1,19 +1,28 @@
 #include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <pthread.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h> // IWYU pragma: keep // required for abort
+#include <string.h>
 #include <sys/queue.h>
 
+#include "baseline.h"
+#include "device_group.h"
+#include "histogram.h"
 #include "journal.h"
+#include "key_class.h"
+#include "key_merge.h"
+#include "probes.h"
+#include "rate_series.h"
+#include "sliding_window.h"
+#include "stats_flush_thread.h"
+#include "util.h"
 
 #include "stats_thread.h"
 
-int const max_bucket_ms = 2000;
-int const bucket_width_ms = 10;
-int const num_regular_buckets = max_bucket_ms / bucket_width_ms;
-int const num_buckets = num_regular_buckets + 1; /* overflow bucket */
-
 enum stats_thread_event_type {
   STATS_THREAD_EVENT_TYPE_KEY,
   STATS_THREAD_EVENT_TYPE_FLUSH,
@@ -24,25 +33,131 @@ struct stats_thread_event {
 
   enum stats_thread_event_type type;
 
+  /* enqueued is the CLOCK_MONOTONIC time of submission of a key, if
+   * queue_latency_enabled. */
+  struct timespec enqueued;
+
   union {
     struct {
+      /* time is the CLOCK_MONOTONIC time of the key press */
+      struct timespec time;
+      /* ms is the delay since the previous key on the same device. Unused
+       * if global_order_enabled. */
       int ms;
+      /* key_class is an enum key_class */
+      unsigned char key_class;
+      /* group is the device group id, or -1 */
+      int group;
     } key;
     struct {
-      struct timeval start_time;
-      struct tm start_time_local;
+      /* begin_ms is the start of the interval to close (CLOCK_REALTIME) */
+      int64_t begin_ms;
     } flush;
   } value;
 };
 
+/* queue_latency buckets are powers of two in usec, plus overflow. */
+enum { num_queue_latency_buckets = 25 };
+
+/*
+ * Keys are credited to the interval containing their press time. Two
+ * intervals are open at once: the current one, and the previous one until
+ * its grace period is over and the flush thread closes it. They live in
+ * slot (begin / interval) % 2.
+ */
+enum { num_open_intervals = 2 };
+
+/* stats_interval is the state of one open interval. */
+struct stats_interval {
+  bool open;
+
+  /* begin_ms is the start of the interval (CLOCK_REALTIME), if open. */
+  int64_t begin_ms;
+
+  /* hist is the distribution of delays between keypresses */
+  struct histogram hist;
+
+  /* key_class_count is the number of keys per key class. */
+  int key_class_count[NUM_KEY_CLASSES];
+
+  /* correction_hist is the distribution of delays before backspace/delete */
+  struct histogram correction_hist;
+
+  /* rate[s] is the number of keys in second s of the interval, if
+   * rate_len_sec > 0. Seconds from num_rate on are all zero. */
+  uint16_t *rate;
+  int num_rate;
+
+  /* active_group lists the ids of groups with keys in this interval, so
+   * that closing it only touches those. Same capacity as the group slab. */
+  int *active_group;
+  int num_active_groups;
+};
+
+/* stats_group is the state of one device group. */
+struct stats_group {
+  /* hist[i] is the distribution of delays in interval slot i */
+  struct histogram hist[num_open_intervals];
+
+  /* last_key_ns is the press time of the group's last key, if
+   * global_order_enabled. */
+  int64_t last_key_ns;
+};
+
 static struct {
-  /* buckets is the distribution of delays between keypresses in the current
-   * interval */
-  int bucket[num_buckets];
+  /* interval holds the open intervals, see num_open_intervals. */
+  struct stats_interval interval[num_open_intervals];
+
+  /* closed_through_ms is the start of the last closed interval. Keys
+   * pressed before its end are too late, and go to the next interval. */
+  int64_t closed_through_ms;
+
+  /* rate_len_sec is the length of the rate series of each interval, or 0 if
+   * intervals are too short for one. */
+  int rate_len_sec;
+
+  /* rate_buf holds an encoded rate series, of any length. */
+  char *rate_buf;
+  size_t rate_buf_len;
+
+  /* realtime_offset_ns is CLOCK_REALTIME - CLOCK_MONOTONIC, sampled once per
+   * batch of events. Keys are timestamped with the latter. */
+  int64_t realtime_offset_ns;
+
+  /* windows_enabled is set via $WINDOWS. */
+  bool windows_enabled;
+
+  /* windows_written_ms is the second the windows were last written for,
+   * and window_written[w] what window w was then (empty if not written). */
+  int64_t windows_written_ms;
+  struct histogram window_written[num_sliding_windows];
+
+  /* global_order_enabled is set via $GLOBAL_ORDER. Then delays are computed
+   * here, across all devices, rather than per device. */
+  bool global_order_enabled;
+
+  /* reorder_window_ns is how long keys are held back to be merged with keys
+   * from other devices, if global_order_enabled. Set via $REORDER_WINDOW. */
+  int64_t reorder_window_ns;
 
-  /* num_keys is the total number of keys pressed in the current interval,
-   * across all buckets. */
-  int num_keys;
+  /* newest_key_ns is the latest press time seen, if global_order_enabled. */
+  int64_t newest_key_ns;
+
+  /* last_key_ns is the press time of the last key added to a bucket, if
+   * global_order_enabled. */
+  int64_t last_key_ns;
+
+  /* group is a slab of per device group state, indexed by group id. It only
+   * grows, and only the stats thread accesses it. */
+  struct stats_group *group;
+  int num_groups;
+
+  /* queue_latency_enabled is set via $QUEUE_LATENCY. */
+  bool queue_latency_enabled;
+
+  /* queue_latency is the distribution of enqueue-to-dequeue latencies of
+   * keys since the last interval was written, if queue_latency_enabled. */
+  int queue_latency[num_queue_latency_buckets];
 
   /* queue_head holds events send to this thread. New events go at the end. */
   TAILQ_HEAD(tailhead, stats_thread_event) queue_head;
@@ -55,15 +170,24 @@ static struct {
   pthread_cond_t queue_cond;
 } stats_thread_data;
 
-int stats_thread_submit_key(struct timespec *wall, struct timespec *delta) {
+int stats_thread_submit_key(struct timespec *wall, struct timespec *delta,
+                            int key_class, int group) {
 
   struct stats_thread_event *e = calloc(sizeof(struct stats_thread_event), 1);
   if (!e)
     return 1;
 
   e->type = STATS_THREAD_EVENT_TYPE_KEY;
+  e->value.key.time = *wall;
+  e->value.key.key_class = key_class;
+  e->value.key.group = group;
   e->value.key.ms = delta->tv_sec * 1000 + delta->tv_nsec / 1000000;
 
+  QUA_PROBE1(submit_key, e->value.key.ms);
+
+  if (stats_thread_data.queue_latency_enabled)
+    clock_gettime(CLOCK_MONOTONIC, &e->enqueued);
+
   pthread_mutex_lock(&stats_thread_data.queue_mutex);
   TAILQ_INSERT_TAIL(&stats_thread_data.queue_head, e, entries);
   pthread_mutex_unlock(&stats_thread_data.queue_mutex);
@@ -72,15 +196,41 @@ int stats_thread_submit_key(struct timespec *wall, struct timespec *delta) {
   return 0;
 }
 
-int stats_thread_submit_flush(struct timeval start_time,
-                              struct tm start_time_local) {
+int stats_thread_submit_key_at(struct timespec *time, int key_class,
+                               int group) {
+  struct stats_thread_event *e = calloc(sizeof(struct stats_thread_event), 1);
+  if (!e)
+    return 1;
+
+  e->type = STATS_THREAD_EVENT_TYPE_KEY;
+  e->value.key.time = *time;
+  e->value.key.key_class = key_class;
+  e->value.key.group = group;
+
+  QUA_PROBE1(submit_key, -1);
+
+  if (stats_thread_data.queue_latency_enabled)
+    clock_gettime(CLOCK_MONOTONIC, &e->enqueued);
+
+  pthread_mutex_lock(&stats_thread_data.queue_mutex);
+  TAILQ_INSERT_TAIL(&stats_thread_data.queue_head, e, entries);
+  pthread_mutex_unlock(&stats_thread_data.queue_mutex);
+  pthread_cond_signal(&stats_thread_data.queue_cond);
+
+  return 0;
+}
+
+bool stats_thread_global_order(void) {
+  return stats_thread_data.global_order_enabled;
+}
+
+int stats_thread_submit_flush(int64_t begin_ms) {
   struct stats_thread_event *e = calloc(sizeof(struct stats_thread_event), 1);
   if (!e)
     return 1;
 
   e->type = STATS_THREAD_EVENT_TYPE_FLUSH;
-  e->value.flush.start_time = start_time;
-  e->value.flush.start_time_local = start_time_local;
+  e->value.flush.begin_ms = begin_ms;
 
   pthread_mutex_lock(&stats_thread_data.queue_mutex);
   TAILQ_INSERT_TAIL(&stats_thread_data.queue_head, e, entries);
@@ -90,84 +240,520 @@ int stats_thread_submit_flush(struct timeval start_time,
   return 0;
 }
 
-static int bucket_index_from_msec(int msec) {
-  if (msec < 0)
-    return 0;
-  if (msec > max_bucket_ms)
-    return num_regular_buckets; /* overflow bucket */
-  return msec / bucket_width_ms;
+/* rate_add counts a key pressed at ns (CLOCK_MONOTONIC) in the rate series. */
+static void rate_add(struct stats_interval *interval, int64_t ns) {
+  int64_t t_ms = (ns + stats_thread_data.realtime_offset_ns) / 1000000;
+  int64_t s = (t_ms - interval->begin_ms) / 1000;
+
+  /* Late keys count as the first second of the interval they went to */
+  if (s < 0)
+    s = 0;
+  if (s >= stats_thread_data.rate_len_sec)
+    s = stats_thread_data.rate_len_sec - 1;
+
+  if (interval->rate[s] < UINT16_MAX)
+    interval->rate[s]++;
+  if (s >= interval->num_rate)
+    interval->num_rate = s + 1;
 }
 
-static int bucket_index_to_bucket_name(int idx, char *out, size_t out_len) {
-  if (idx >= num_regular_buckets)
-    return snprintf(out, out_len, "inf");
-  return snprintf(out, out_len, "%d", bucket_width_ms * idx);
+static void bucket_add_msec(struct stats_interval *interval, int64_t ns,
+                            int msec, int key_class) {
+  QUA_PROBE1(bucket_add, msec);
+  histogram_add_msec(&interval->hist, msec);
+
+  interval->key_class_count[key_class]++;
+  if (key_class == KEY_CLASS_CORRECTION)
+    histogram_add_msec(&interval->correction_hist, msec);
+
+  if (stats_thread_data.windows_enabled)
+    sliding_window_add((ns + stats_thread_data.realtime_offset_ns) / 1000000000,
+                       histogram_index_from_msec(msec));
+
+  if (stats_thread_data.rate_len_sec > 0)
+    rate_add(interval, ns);
 }
 
-static void bucket_add_msec(int msec) {
-  stats_thread_data.bucket[bucket_index_from_msec(msec)]++;
-  stats_thread_data.num_keys++;
+/*
+ * group_get returns the state of group id, growing the slab if the group is
+ * new. Returns NULL if the key is not grouped (or on error).
+ */
+static struct stats_group *group_get(int id) {
+  if (id < 0)
+    return NULL;
+
+  if (id >= stats_thread_data.num_groups) {
+    int num = stats_thread_data.num_groups ? stats_thread_data.num_groups : 16;
+    while (num <= id)
+      num *= 2;
+
+    struct stats_group *group =
+        realloc(stats_thread_data.group, num * sizeof(*group));
+    if (!group) {
+      fprintf(stderr, "error: %m\n");
+      return NULL;
+    }
+    stats_thread_data.group = group;
+
+    for (int i = 0; i < num_open_intervals; i++) {
+      struct stats_interval *interval = &stats_thread_data.interval[i];
+      int *active = realloc(interval->active_group, num * sizeof(*active));
+      if (!active) {
+        fprintf(stderr, "error: %m\n");
+        return NULL;
+      }
+      interval->active_group = active;
+    }
+
+    memset(&group[stats_thread_data.num_groups], 0,
+           (num - stats_thread_data.num_groups) * sizeof(*group));
+    stats_thread_data.num_groups = num;
+  }
+
+  return &stats_thread_data.group[id];
 }
 
-static void stats_thread_flush(struct timeval *start_time,
-                               struct tm *start_time_local) {
+/* group_add_msec adds a key to group id. O(1), like bucket_add_msec. */
+static void group_add_msec(struct stats_interval *interval, int id,
+                           int msec) {
+  struct stats_group *group = group_get(id);
+  if (!group)
+    return;
+
+  struct histogram *hist = &group->hist[interval - stats_thread_data.interval];
+  if (hist->num_keys == 0)
+    interval->active_group[interval->num_active_groups++] = id;
+  histogram_add_msec(hist, msec);
+}
 
-  char start_time_local_str[64];
+static int64_t timespec_to_ns(struct timespec *t) {
+  return t->tv_sec * 1000000000LL + t->tv_nsec;
+}
+
+static struct stats_interval *interval_of(int64_t ns);
+
+/* global_order_add_key adds a key, given its press time, to the buckets. */
+static void global_order_add_key(struct key_press *key) {
+  struct stats_interval *interval = interval_of(key->ns);
+  int64_t delta_ms = (key->ns - stats_thread_data.last_key_ns) / 1000000;
+
+  stats_thread_data.last_key_ns = key->ns;
+  bucket_add_msec(interval, key->ns,
+                  delta_ms > INT_MAX ? INT_MAX : delta_ms, key->key_class);
+
+  /* Within a group, the delay is since the previous key of that group. */
+  struct stats_group *group = group_get(key->group);
+  if (group) {
+    delta_ms = (key->ns - group->last_key_ns) / 1000000;
+    group->last_key_ns = key->ns;
+    group_add_msec(interval, key->group,
+                   delta_ms > INT_MAX ? INT_MAX : delta_ms);
+  }
+}
+
+/* global_order_release adds all held back keys pressed up to until_ns. */
+static void global_order_release(int64_t until_ns) {
+  struct key_press key;
+
+  while (0 == key_merge_pop(until_ns, &key))
+    global_order_add_key(&key);
+}
+
+/*
+ * global_order_add holds a key back until no earlier key can arrive from
+ * another device anymore, i.e. until a key at least reorder_window_ns newer
+ * has been seen (or a flush happens).
+ */
+static void global_order_add(struct timespec *time, int key_class,
+                             int group) {
+  struct key_press key = {
+      .ns = timespec_to_ns(time),
+      .key_class = key_class,
+      .group = group,
+  };
+  struct key_press evicted;
+
+  if (key.ns > stats_thread_data.newest_key_ns)
+    stats_thread_data.newest_key_ns = key.ns;
+
+  if (key_merge_push(&key, &evicted))
+    global_order_add_key(&evicted); /* buffer full */
+
+  global_order_release(stats_thread_data.newest_key_ns -
+                       stats_thread_data.reorder_window_ns);
+}
+
+/*
+ * queue_latency_index maps an enqueue-to-dequeue latency to a bucket of
+ * queue_latency. Bucket i counts latencies below 2^i usec.
+ */
+static int queue_latency_index(struct timespec *latency) {
+  long long usec = latency->tv_sec * 1000000LL + latency->tv_nsec / 1000;
+  int idx = 0;
+
+  while (idx < num_queue_latency_buckets - 1 && usec >= (1LL << idx))
+    idx++;
+  return idx;
+}
+
+static void queue_latency_add(struct stats_thread_event *e) {
+  struct timespec now;
+  struct timespec latency;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  timespec_subtract(&latency, &now, &e->enqueued);
+  stats_thread_data.queue_latency[queue_latency_index(&latency)]++;
+}
+
+/*
+ * buf_append appends to the buffer at *buf_ptr, and advances *buf_ptr.
+ * Returns 0 on success, 1 if the output did not fit.
+ */
+static int __attribute__((format(printf, 3, 4)))
+buf_append(char **buf_ptr, char *buf_end, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int ret = vsnprintf(*buf_ptr, buf_end - *buf_ptr, format, args);
+  va_end(args);
+
+  if (ret < 0 || *buf_ptr + ret >= buf_end)
+    return 1;
+  *buf_ptr += ret;
+  return 0;
+}
+
+/*
+ * buf_append_string appends str as a JSON string. Control characters, which
+ * device names should not contain anyway, are replaced by '?'.
+ */
+static int buf_append_string(char **buf_ptr, char *buf_end, const char *str) {
+  if (buf_append(buf_ptr, buf_end, "\""))
+    return 1;
+
+  for (const char *c = str; *c; c++) {
+    int ret;
+    if (*c == '"' || *c == '\\')
+      ret = buf_append(buf_ptr, buf_end, "\\%c", *c);
+    else if ((unsigned char)*c < 0x20)
+      ret = buf_append(buf_ptr, buf_end, "?");
+    else
+      ret = buf_append(buf_ptr, buf_end, "%c", *c);
+    if (ret)
+      return 1;
+  }
+
+  return buf_append(buf_ptr, buf_end, "\"");
+}
+
+/* buf_append_histogram appends hist as a JSON object of nonzero buckets. */
+static int buf_append_histogram(char **buf_ptr, char *buf_end,
+                                const struct histogram *hist) {
   char bucket_name[32];
-  char buf[65536];
-  char *buf_end = &buf[sizeof(buf)];
-  char *buf_ptr = buf;
-  int ret;
+  bool not_first = false;
+
+  if (buf_append(buf_ptr, buf_end, "{"))
+    return 1;
 
-  strftime(start_time_local_str, sizeof(start_time_local_str),
-           "%Y-%m-%d %H:%M:%S", start_time_local);
+  for (int i = histogram_next(hist, 0); i >= 0;
+       i = histogram_next(hist, i + 1)) {
+    histogram_index_to_bucket_name(i, bucket_name, sizeof(bucket_name));
+    if (buf_append(buf_ptr, buf_end, "%s\"%s\":%d", not_first ? "," : "",
+                   bucket_name, hist->bucket[i]))
+      return 1;
+    not_first = true;
+  }
 
-  ret = snprintf(buf_ptr, buf_end - buf_ptr,
-                 "{\"t\":\"%ld\",\"l\":\"%s\",\"e\":{", start_time->tv_sec,
-                 start_time_local_str);
-  if (ret < 0 || buf_ptr + ret >= buf_end)
-    goto err;
-  buf_ptr += ret;
+  return buf_append(buf_ptr, buf_end, "}");
+}
 
+/* buf_append_key_classes appends ,"c":{...}, the number of keys per class. */
+static int buf_append_key_classes(char **buf_ptr, char *buf_end,
+                                  const struct stats_interval *interval) {
   bool not_first = false;
-  for (int i = 0; i < num_buckets; i++) {
-    if (stats_thread_data.bucket[i] <= 0)
+
+  if (buf_append(buf_ptr, buf_end, ",\"c\":{"))
+    return 1;
+
+  for (int i = 0; i < NUM_KEY_CLASSES; i++) {
+    if (interval->key_class_count[i] <= 0)
       continue;
-    if (not_first) {
-      ret = snprintf(buf_ptr, buf_end - buf_ptr, ",");
-      if (ret < 0 || buf_ptr + ret >= buf_end)
-        goto err;
-      buf_ptr += ret;
+    if (buf_append(buf_ptr, buf_end, "%s\"%s\":%d", not_first ? "," : "",
+                   key_class_name(i), interval->key_class_count[i]))
+      return 1;
+    not_first = true;
+  }
+
+  return buf_append(buf_ptr, buf_end, "}");
+}
+
+/* buf_append_queue_latency appends ,"q":{...} keyed by upper bound in usec. */
+static int buf_append_queue_latency(char **buf_ptr, char *buf_end) {
+  bool not_first = false;
+
+  if (buf_append(buf_ptr, buf_end, ",\"q\":{"))
+    return 1;
+
+  for (int i = 0; i < num_queue_latency_buckets; i++) {
+    if (stats_thread_data.queue_latency[i] <= 0)
+      continue;
+    if (i == num_queue_latency_buckets - 1) {
+      if (buf_append(buf_ptr, buf_end, "%s\"inf\":%d", not_first ? "," : "",
+                     stats_thread_data.queue_latency[i]))
+        return 1;
     } else {
-      not_first = true;
+      if (buf_append(buf_ptr, buf_end, "%s\"%lld\":%d", not_first ? "," : "",
+                     1LL << i, stats_thread_data.queue_latency[i]))
+        return 1;
     }
+    not_first = true;
+  }
+
+  return buf_append(buf_ptr, buf_end, "}");
+}
+
+/* buf_append_time appends {"t":...,"l":... for the interval starting at t. */
+static int buf_append_time(char **buf_ptr, char *buf_end, int64_t t_ms) {
+  char t_local_str[64];
+  time_t t = t_ms / 1000;
+  struct tm t_local;
+
+  localtime_r(&t, &t_local);
+  strftime(t_local_str, sizeof(t_local_str), "%Y-%m-%d %H:%M:%S", &t_local);
+
+  /* Sub-second intervals need a fractional timestamp to stay unique. */
+  if (stats_flush_thread_interval_ms() % 1000 != 0)
+    return buf_append(buf_ptr, buf_end,
+                      "{\"t\":\"%" PRId64 ".%03" PRId64 "\",\"l\":\"%s\"",
+                      t_ms / 1000, t_ms % 1000, t_local_str);
+
+  return buf_append(buf_ptr, buf_end, "{\"t\":\"%" PRId64 "\",\"l\":\"%s\"",
+                    t_ms / 1000, t_local_str);
+}
+
+static void stats_thread_flush(struct stats_interval *interval,
+                               struct tm *begin_local) {
+
+  char buf[65536];
+  char *buf_end = &buf[sizeof(buf)];
+  char *buf_ptr = buf;
+  double score;
+
+  QUA_PROBE1(flush_start, interval->hist.num_keys);
+
+  if (buf_append_time(&buf_ptr, buf_end, interval->begin_ms))
+    goto err;
+
+  if (buf_append(&buf_ptr, buf_end, ",\"e\":"))
+    goto err;
+  if (buf_append_histogram(&buf_ptr, buf_end, &interval->hist))
+    goto err;
 
-    bucket_index_to_bucket_name(i, bucket_name, sizeof(bucket_name));
-    ret = snprintf(buf_ptr, buf_end - buf_ptr, "\"%s\":%d", bucket_name,
-                   stats_thread_data.bucket[i]);
-    if (ret < 0 || buf_ptr + ret >= buf_end)
+  if (buf_append_key_classes(&buf_ptr, buf_end, interval))
+    goto err;
+
+  if (interval->correction_hist.num_keys > 0) {
+    if (buf_append(&buf_ptr, buf_end, ",\"b\":"))
+      goto err;
+    if (buf_append_histogram(&buf_ptr, buf_end, &interval->correction_hist))
       goto err;
-    buf_ptr += ret;
   }
 
-  ret = snprintf(buf_ptr, buf_end - buf_ptr, "}}\n");
-  if (ret < 0 || buf_ptr + ret >= buf_end)
-    goto err;
-  buf_ptr += ret;
+  /* Distance from the usual distribution at this hour of the week */
+  if (0 == baseline_score(&interval->hist, interval->begin_ms, begin_local,
+                          &score))
+    if (buf_append(&buf_ptr, buf_end, ",\"a\":%.1f", score))
+      goto err;
 
-  journal_add("%s", buf);
+  if (stats_thread_data.queue_latency_enabled)
+    if (buf_append_queue_latency(&buf_ptr, buf_end))
+      goto err;
+
+  /* The rate series of long intervals can be longer than buf */
+  if (interval->num_rate > 0) {
+    if (0 > rate_series_encode(interval->rate, interval->num_rate,
+                               stats_thread_data.rate_buf,
+                               stats_thread_data.rate_buf_len))
+      goto err;
+    journal_add("%s,\"r\":\"%s\"}\n", buf, stats_thread_data.rate_buf);
+  } else {
+    journal_add("%s}\n", buf);
+  }
 
 err:
+  QUA_PROBE(flush_end);
   return;
 }
 
-static void stats_thread_reset(void) {
-  stats_thread_data.num_keys = 0;
-  for (int i = 0; i < num_buckets; i++) {
-    stats_thread_data.bucket[i] = 0;
+/*
+ * stats_thread_flush_windows writes one line per sliding window that is
+ * nonempty and changed since it was last written, tagged with "w" (its
+ * length in seconds). Windows are kept to the second, so they are written
+ * at most once per second: "t" is the last whole second up to the end of
+ * the interval that just closed, and the window covers the "w" seconds
+ * before it. Keys pressed since are left out.
+ */
+static void stats_thread_flush_windows(int64_t begin_ms) {
+  char buf[65536];
+  char *buf_end = &buf[sizeof(buf)];
+  struct timespec now;
+  struct histogram hist;
+
+  int64_t end_ms = begin_ms + stats_flush_thread_interval_ms();
+  int64_t t_ms = end_ms - end_ms % 1000;
+  if (t_ms <= stats_thread_data.windows_written_ms)
+    return; /* Sub-second intervals: this second is done already */
+  stats_thread_data.windows_written_ms = t_ms;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  sliding_window_advance(now.tv_sec);
+
+  for (int w = 0; w < num_sliding_windows; w++) {
+    struct histogram *written = &stats_thread_data.window_written[w];
+    char *buf_ptr = buf;
+
+    /* As of the end of the second before t */
+    if (0 != sliding_window_get_at(w, t_ms / 1000 - 1, &hist))
+      continue; /* Flushed too late to tell */
+
+    if (hist.num_keys == written->num_keys &&
+        0 == memcmp(hist.bucket, written->bucket, sizeof(hist.bucket)))
+      continue; /* Unchanged (or still empty) */
+    *written = hist;
+    if (hist.num_keys <= 0)
+      continue;
+
+    if (buf_append_time(&buf_ptr, buf_end, t_ms))
+      continue;
+    if (buf_append(&buf_ptr, buf_end, ",\"w\":\"%d\",\"e\":",
+                   sliding_window_len_sec[w]))
+      continue;
+    if (buf_append_histogram(&buf_ptr, buf_end, &hist))
+      continue;
+    if (buf_append(&buf_ptr, buf_end, "}\n"))
+      continue;
+
+    journal_add("%s", buf);
   }
 }
 
+/*
+ * stats_thread_flush_groups writes one line per group with keys in the
+ * interval, tagged with "g" (the group name), and resets those groups.
+ */
+static void stats_thread_flush_groups(struct stats_interval *interval) {
+  char buf[65536];
+  char *buf_end = &buf[sizeof(buf)];
+  int slot = interval - stats_thread_data.interval;
+
+  for (int i = 0; i < interval->num_active_groups; i++) {
+    int id = interval->active_group[i];
+    struct histogram *hist = &stats_thread_data.group[id].hist[slot];
+    char *buf_ptr = buf;
+
+    if (buf_append_time(&buf_ptr, buf_end, interval->begin_ms))
+      goto next;
+    if (buf_append(&buf_ptr, buf_end, ",\"g\":"))
+      goto next;
+    if (buf_append_string(&buf_ptr, buf_end, device_group_name(id)))
+      goto next;
+    if (buf_append(&buf_ptr, buf_end, ",\"e\":"))
+      goto next;
+    if (buf_append_histogram(&buf_ptr, buf_end, hist))
+      goto next;
+    if (buf_append(&buf_ptr, buf_end, "}\n"))
+      goto next;
+
+    journal_add("%s", buf);
+
+  next:
+    histogram_reset(hist);
+  }
+
+  interval->num_active_groups = 0;
+}
+
+/* interval_close writes the records of interval, and resets it. */
+static void interval_close(struct stats_interval *interval) {
+  if (interval->hist.num_keys > 0) {
+    time_t begin = interval->begin_ms / 1000;
+    struct tm begin_local;
+    localtime_r(&begin, &begin_local);
+
+    stats_thread_flush(interval, &begin_local);
+    baseline_update(&interval->hist, interval->begin_ms, &begin_local);
+    memset(stats_thread_data.queue_latency, 0,
+           sizeof(stats_thread_data.queue_latency));
+  }
+  stats_thread_flush_groups(interval);
+
+  histogram_reset(&interval->hist);
+  histogram_reset(&interval->correction_hist);
+  memset(interval->key_class_count, 0, sizeof(interval->key_class_count));
+  if (interval->num_rate > 0)
+    memset(interval->rate, 0, interval->num_rate * sizeof(*interval->rate));
+  interval->num_rate = 0;
+  interval->open = false;
+
+  if (interval->begin_ms > stats_thread_data.closed_through_ms)
+    stats_thread_data.closed_through_ms = interval->begin_ms;
+}
+
+/* interval_close_through closes all intervals starting up to through_ms. */
+static void interval_close_through(int64_t through_ms) {
+  struct stats_interval *a = &stats_thread_data.interval[0];
+  struct stats_interval *b = &stats_thread_data.interval[1];
+
+  /* Oldest first, to keep the journal ordered */
+  if (a->open && b->open && b->begin_ms < a->begin_ms) {
+    a = &stats_thread_data.interval[1];
+    b = &stats_thread_data.interval[0];
+  }
+
+  if (a->open && a->begin_ms <= through_ms)
+    interval_close(a);
+  if (b->open && b->begin_ms <= through_ms)
+    interval_close(b);
+
+  if (through_ms > stats_thread_data.closed_through_ms)
+    stats_thread_data.closed_through_ms = through_ms;
+}
+
+/*
+ * interval_of returns the interval containing press time ns
+ * (CLOCK_MONOTONIC), opening it if necessary. Opening an interval closes
+ * all but the one before it. Keys for already closed intervals are late,
+ * and are credited to the oldest interval that is still open.
+ */
+static struct stats_interval *interval_of(int64_t ns) {
+  int64_t interval_ms = stats_flush_thread_interval_ms();
+  int64_t t_ms = (ns + stats_thread_data.realtime_offset_ns) / 1000000;
+  int64_t begin_ms = t_ms - t_ms % interval_ms;
+
+  if (begin_ms <= stats_thread_data.closed_through_ms)
+    begin_ms = stats_thread_data.closed_through_ms + interval_ms;
+
+  struct stats_interval *interval =
+      &stats_thread_data.interval[(begin_ms / interval_ms) % num_open_intervals];
+  if (interval->open && interval->begin_ms == begin_ms)
+    return interval;
+
+  interval_close_through(begin_ms - num_open_intervals * interval_ms);
+  interval->open = true;
+  interval->begin_ms = begin_ms;
+  return interval;
+}
+
+/* realtime_offset_update samples CLOCK_REALTIME - CLOCK_MONOTONIC. */
+static void realtime_offset_update(void) {
+  struct timespec mono;
+  struct timespec real;
+
+  clock_gettime(CLOCK_MONOTONIC, &mono);
+  clock_gettime(CLOCK_REALTIME, &real);
+  stats_thread_data.realtime_offset_ns =
+      timespec_to_ns(&real) - timespec_to_ns(&mono);
+}
+
 static void *stats_thread(void *arg) {
   int ret;
 
@@ -183,6 +769,9 @@ static void *stats_thread(void *arg) {
       pthread_mutex_unlock(&stats_thread_data.queue_mutex);
     } while (true);
 
+    /* Once per batch is enough; the offset only changes with clock steps. */
+    realtime_offset_update();
+
     /* process all elements */
     while (stats_thread_data.queue_head.tqh_first != NULL) {
       struct stats_thread_event *e = stats_thread_data.queue_head.tqh_first;
@@ -190,17 +779,48 @@ static void *stats_thread(void *arg) {
       TAILQ_REMOVE(&stats_thread_data.queue_head,
                    stats_thread_data.queue_head.tqh_first, entries);
 
+      QUA_PROBE1(dequeue, e->type);
+
+      /* Flushes come from a timer, not from devices, so are not counted */
+      if (stats_thread_data.queue_latency_enabled &&
+          e->type == STATS_THREAD_EVENT_TYPE_KEY)
+        queue_latency_add(e);
+
       switch (e->type) {
       case STATS_THREAD_EVENT_TYPE_KEY:
-        bucket_add_msec(e->value.key.ms);
+        if (stats_thread_data.global_order_enabled) {
+          global_order_add(&e->value.key.time, e->value.key.key_class,
+                           e->value.key.group);
+        } else {
+          struct stats_interval *interval =
+              interval_of(timespec_to_ns(&e->value.key.time));
+          bucket_add_msec(interval, timespec_to_ns(&e->value.key.time),
+                          e->value.key.ms, e->value.key.key_class);
+          group_add_msec(interval, e->value.key.group, e->value.key.ms);
+        }
         break;
 
       case STATS_THREAD_EVENT_TYPE_FLUSH:
         pthread_mutex_unlock(&stats_thread_data.queue_mutex);
-        if (stats_thread_data.num_keys > 0)
-          stats_thread_flush(&e->value.flush.start_time,
-                             &e->value.flush.start_time_local);
-        stats_thread_reset();
+        if (stats_thread_data.global_order_enabled) {
+          /*
+           * Keys pressed before the end of the intervals being closed must
+           * go into them, even if the reorder window is longer than the
+           * grace period; keys from other devices that precede them would
+           * be late anyway.
+           */
+          struct timespec now;
+          clock_gettime(CLOCK_MONOTONIC, &now);
+          int64_t until_ns =
+              timespec_to_ns(&now) - stats_thread_data.reorder_window_ns;
+          int64_t end_ns = (e->value.flush.begin_ms +
+                            stats_flush_thread_interval_ms()) * 1000000 -
+                           stats_thread_data.realtime_offset_ns - 1;
+          global_order_release(end_ns > until_ns ? end_ns : until_ns);
+        }
+        interval_close_through(e->value.flush.begin_ms);
+        if (stats_thread_data.windows_enabled)
+          stats_thread_flush_windows(e->value.flush.begin_ms);
         pthread_mutex_lock(&stats_thread_data.queue_mutex);
         break;
       default:
@@ -216,6 +836,57 @@ static void *stats_thread(void *arg) {
   return NULL;
 }
 
+int stats_thread_init(void) {
+  char *queue_latency_str = getenv("QUEUE_LATENCY");
+  char *windows_str = getenv("WINDOWS");
+  char *global_order_str = getenv("GLOBAL_ORDER");
+  char *reorder_window_str = getenv("REORDER_WINDOW");
+
+  stats_thread_data.queue_latency_enabled =
+      queue_latency_str && atoi(queue_latency_str) != 0;
+
+  stats_thread_data.windows_enabled = windows_str && atoi(windows_str) != 0;
+  if (stats_thread_data.windows_enabled && 0 != sliding_window_init())
+    return 1;
+
+  stats_thread_data.global_order_enabled =
+      global_order_str && atoi(global_order_str) != 0;
+
+  /* $REORDER_WINDOW is in msec */
+  long reorder_window_ms = 50;
+  if (reorder_window_str && *reorder_window_str)
+    reorder_window_ms = atol(reorder_window_str);
+  if (reorder_window_ms < 0 || reorder_window_ms > 10000) {
+    fprintf(stderr, "error: bad reorder window: %ld. must be between 0 and "
+                    "10000 (msec).\n", reorder_window_ms);
+    return 1;
+  }
+  stats_thread_data.reorder_window_ns = reorder_window_ms * 1000000;
+
+  /* A rate series needs at least two whole seconds to say anything */
+  long interval_ms = stats_flush_thread_interval_ms();
+  if (interval_ms >= 2000 && interval_ms % 1000 == 0) {
+    stats_thread_data.rate_len_sec = interval_ms / 1000;
+    stats_thread_data.rate_buf_len =
+        stats_thread_data.rate_len_sec * rate_series_max_token_len + 1;
+    stats_thread_data.rate_buf = malloc(stats_thread_data.rate_buf_len);
+    if (!stats_thread_data.rate_buf) {
+      fprintf(stderr, "error: %m\n");
+      return 1;
+    }
+    for (int i = 0; i < num_open_intervals; i++) {
+      stats_thread_data.interval[i].rate =
+          calloc(stats_thread_data.rate_len_sec, sizeof(uint16_t));
+      if (!stats_thread_data.interval[i].rate) {
+        fprintf(stderr, "error: %m\n");
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
 int spawn_stats_thread(void) {
   int ret = 1; /* Error */
 
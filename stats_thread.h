@@ -1,14 +1,31 @@
 #ifndef QUA_STATS_THREAD_H
 #define QUA_STATS_THREAD_H
 
-#include <sys/time.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
+int stats_thread_init(void);
 int spawn_stats_thread(void);
 
-int stats_thread_submit_key(struct timespec *wall, struct timespec *delta);
+/* key_class is an enum key_class, group a device group id or -1. */
+int stats_thread_submit_key(struct timespec *wall, struct timespec *delta,
+                            int key_class, int group);
 
-int stats_thread_submit_flush(struct timeval start_time,
-                              struct tm start_time_local);
+/*
+ * stats_thread_submit_key_at submits a key pressed at time (CLOCK_MONOTONIC).
+ * Only for global order mode, where the delay is computed across devices.
+ */
+int stats_thread_submit_key_at(struct timespec *time, int key_class,
+                               int group);
+
+/* stats_thread_global_order returns whether global order mode is enabled. */
+bool stats_thread_global_order(void);
+
+/*
+ * stats_thread_submit_flush closes all intervals starting up to begin_ms
+ * (msec since the epoch), and writes them to the journal.
+ */
+int stats_thread_submit_flush(int64_t begin_ms);
 
 #endif
@@ -0,0 +1,39 @@
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "test_util.h"
+
+int64_t now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+void sleep_ms(long ms) {
+  struct timespec t = {
+      .tv_sec = ms / 1000,
+      .tv_nsec = (ms % 1000) * 1000000,
+  };
+  while (0 != nanosleep(&t, &t) && errno == EINTR)
+    ;
+}
+
+long rss_kb(pid_t pid) {
+  char path[64];
+  long pages = -1;
+
+  if (pid)
+    snprintf(path, sizeof(path), "/proc/%d/statm", (int)pid);
+  else
+    snprintf(path, sizeof(path), "/proc/self/statm");
+
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return -1;
+  if (1 != fscanf(f, "%*s %ld", &pages))
+    pages = -1;
+  fclose(f);
+  return pages < 0 ? -1 : pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
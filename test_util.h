@@ -0,0 +1,18 @@
+#ifndef QUA_TEST_UTIL_H
+#define QUA_TEST_UTIL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Helpers shared by the tests and benchmarks (qt-*). */
+
+/* now_ns returns the current CLOCK_MONOTONIC time in nsec. */
+int64_t now_ns(void);
+
+/* sleep_ms sleeps for ms msec, also if interrupted by signals. */
+void sleep_ms(long ms);
+
+/* rss_kb returns the resident set size of process pid (0: this one), or -1. */
+long rss_kb(pid_t pid);
+
+#endif
@@ -12,3 +12,10 @@ void timespec_subtract(struct timespec *out, struct timespec *a, struct timespec
     out->tv_sec -= 1;
   }
 }
+
+int64_t realtime_ms(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
@@ -1,6 +1,12 @@
 #ifndef QUA_UTIL_H
 #define QUA_UTIL_H
 
+#include <stdint.h>
+#include <time.h>
+
 void timespec_subtract(struct timespec *out, struct timespec *a, struct timespec *b);
 
+/* realtime_ms returns the current CLOCK_REALTIME time in msec. */
+int64_t realtime_ms(void);
+
 #endif